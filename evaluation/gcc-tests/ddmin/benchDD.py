@@ -0,0 +1,99 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+# The Python side of src/ddmin/DDBench.cpp: ddmin over the characters of
+# each file with the same synthetic oracle (FAIL iff every one of TARGETS
+# evenly spaced characters is still there), run with DD.py and with
+# ddmin.py. Prints the same columns as DDBench so the two can be pasted
+# together.
+
+import optparse
+import os
+import sys
+import time
+
+import DD
+import ddmin
+
+
+def failureInducing(size, targets):
+    stride = max(size / max(targets, 1), 1)
+    return range(0, size, stride)
+
+
+class SyntheticDD(DD.DD):
+    def __init__(self, targets):
+        DD.DD.__init__(self)
+        self.targets = targets
+        self.tests = 0
+
+    def _test(self, c):
+        self.tests += 1
+        present = set(c)
+        for target in self.targets:
+            if target not in present:
+                return self.PASS
+        return self.FAIL
+
+
+def benchDD(size, targets):
+    dd = SyntheticDD(failureInducing(size, targets))
+    # DD.py reports every round on stdout
+    stdout = sys.stdout
+    sys.stdout = open(os.devnull, 'w')
+    try:
+        start = time.time()
+        minimal = dd.ddmin(range(size))
+        seconds = time.time() - start
+    finally:
+        sys.stdout.close()
+        sys.stdout = stdout
+    return len(minimal), dd.tests, seconds
+
+
+def benchDdmin(size, targets):
+    wanted = failureInducing(size, targets)
+    counter = [0]
+
+    def test(c):
+        counter[0] += 1
+        present = set(c)
+        for target in wanted:
+            if target not in present:
+                return ddmin.PASS
+        return ddmin.FAIL
+
+    start = time.time()
+    minimal = ddmin.ddmin(range(size), test)
+    return len(minimal), counter[0], time.time() - start
+
+
+def main(argv=None):
+    if argv is None:
+        argv = sys.argv
+
+    parser = optparse.OptionParser(usage='%prog [options] <fileName>...')
+    parser.add_option('-t', '--targets', type='int', default=8,
+                      help = 'number of failure-inducing characters')
+    parser.add_option('-r', '--repeat', type='int', default=3,
+                      help = 'report the best of this many runs')
+
+    options, args = parser.parse_args(argv[1:])
+    if len(args) < 1:
+        parser.error('wrong number of positional arguments')
+
+    print "FILE\tDELTAS\tVARIANT\tMINIMAL\tTESTS\tSECONDS"
+    for fileName in args:
+        size = len(open(fileName).read())
+        for variant, bench in [('DD.py', benchDD), ('ddmin.py', benchDdmin)]:
+            best = None
+            for i in xrange(options.repeat):
+                minimal, tests, seconds = bench(size, options.targets)
+                if best is None or seconds < best:
+                    best = seconds
+            print "%s\t%d\t%s\t%d\t%d\t%s" % (fileName, size, variant,
+                                              minimal, tests, best)
+
+
+if __name__ == '__main__':
+    main()
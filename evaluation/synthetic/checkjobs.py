@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Checks that GenerateConstraints writes the same out.txt with jobs=N as
+with one thread, on synthetic inputs of a few shapes and on any files given.
+Exits with 1 and names the inputs that differ if there are any.
+"""
+
+from __future__ import with_statement
+
+import optparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from gensynth import generate
+
+here = os.path.dirname(os.path.abspath(__file__))
+
+# (decls, depth, uses, hot)
+shapes = [(50, 1, 2, 0.0), (200, 3, 4, 0.0), (400, 2, 8, 0.75),
+          (100, 8, 3, 0.25)]
+
+
+def generateFacts(generator, directory, fileName, jobs):
+    arguments = [generator, '-plugin', 'gen-constraints']
+    if jobs > 1:
+        arguments += ['-plugin-arg-gen-constraints', 'jobs=%d' % jobs]
+    devnull = open(os.devnull, 'w')
+    subprocess.call(arguments + [fileName], cwd=directory, stdout=devnull,
+                    stderr=devnull)
+    devnull.close()
+    factsFileName = os.path.join(directory, 'out.txt')
+    if not os.path.exists(factsFileName):
+        return None
+    with open(factsFileName, 'rb') as f:
+        facts = f.read()
+    os.remove(factsFileName)
+    return facts
+
+
+def check(generator, fileName, text, jobs):
+    """True if both runs write the same facts."""
+    directory = tempfile.mkdtemp(prefix='checkjobs-')
+    try:
+        with open(os.path.join(directory, fileName), 'w') as f:
+            f.write(text)
+        serial = generateFacts(generator, directory, fileName, 1)
+        parallel = generateFacts(generator, directory, fileName, jobs)
+        if serial is None:
+            print "%s: NO FACTS" % fileName
+            return False
+        return serial == parallel
+    finally:
+        shutil.rmtree(directory)
+
+
+def main(argv=None):
+    if argv is None:
+        argv = sys.argv
+
+    parser = optparse.OptionParser(usage='%prog [options] [FILE...]')
+    parser.add_option('-g', '--generator',
+                      default=os.path.join(here, '..', '..', 'bin',
+                                           'GenerateConstraints'),
+                      help = 'the GenerateConstraints binary')
+    parser.add_option('-j', '--jobs', type='int', default=4,
+                      help = 'threads of the parallel run')
+    options, args = parser.parse_args(argv[1:])
+    generator = os.path.abspath(options.generator)
+
+    inputs = []
+    for decls, depth, uses, hot in shapes:
+        inputs.append(('synth-%d-%d-%d-%g.c' % (decls, depth, uses, hot),
+                       generate(decls, depth, uses, hot)))
+    for fileName in args:
+        with open(fileName) as f:
+            inputs.append((os.path.basename(fileName), f.read()))
+
+    differing = []
+    for fileName, text in inputs:
+        same = check(generator, fileName, text, options.jobs)
+        print "%s: %s" % (fileName, same and 'SAME' or 'DIFFERENT')
+        if not same:
+            differing.append(fileName)
+    return len(differing) and 1 or 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
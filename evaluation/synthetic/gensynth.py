@@ -0,0 +1,158 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Generate a synthetic C translation unit of a given shape, to see how
+constraint generation and solving scale with it.
+
+    --decls N    N top-level declarations: structs, globals and functions in
+                 about a 1:2:3 mix, plus main
+    --depth D    function bodies nest if-blocks D deep
+    --uses U     every block of a function uses U earlier declarations (the
+                 fan-out of a function grows with U and D)
+    --hot H      fraction of the uses that go to the first few declarations
+                 instead of a uniformly random earlier one (the fan-in of
+                 those few grows with H)
+
+Only earlier declarations are used, so the file compiles. The same seed
+gives the same file.
+"""
+
+import optparse
+import random
+import sys
+
+# how many of the first declarations the hot uses go to
+numberOfHotDecls = 4
+
+
+class Generator(object):
+    def __init__(self, decls, depth, uses, hot, seed):
+        self.decls = decls
+        self.depth = depth
+        self.uses = uses
+        self.hot = hot
+        self.random = random.Random(seed)
+        self.lines = []
+        # (kind, name) of everything declared so far
+        self.declared = []
+
+    def emit(self, line, indent=0):
+        self.lines.append('  ' * indent + line)
+
+    def pickUse(self, kinds):
+        candidates = [d for d in self.declared if d[0] in kinds]
+        if not candidates:
+            return None
+        if self.random.random() < self.hot:
+            return self.random.choice(candidates[:numberOfHotDecls])
+        return self.random.choice(candidates)
+
+    def useExpression(self, local):
+        use = self.pickUse(('global', 'function', 'struct'))
+        if use is None:
+            return local
+        kind, name = use
+        if kind == 'global':
+            return name
+        if kind == 'function':
+            return '%s(%s)' % (name, local)
+        return 'sizeof(struct %s)' % name
+
+    def block(self, level, local, indent):
+        for i in xrange(self.uses):
+            self.emit('%s += %s;' % (local, self.useExpression(local)), indent)
+        if level < self.depth:
+            self.emit('if (%s > %d)' % (local, level), indent)
+            self.emit('{', indent)
+            inner = 'v%d' % (level + 1)
+            self.emit('int %s = %s;' % (inner, local), indent + 1)
+            self.block(level + 1, inner, indent + 1)
+            self.emit('%s += %s;' % (local, inner), indent + 1)
+            self.emit('}', indent)
+
+    def struct(self, index):
+        name = 's%d' % index
+        self.emit('struct %s' % name)
+        self.emit('{')
+        self.emit('int a;', 1)
+        self.emit('int b[%d];' % (index % 7 + 1), 1)
+        self.emit('};')
+        self.emit('')
+        self.declared.append(('struct', name))
+
+    def globalVariable(self, index):
+        name = 'g%d' % index
+        self.emit('int %s = %d;' % (name, index))
+        self.emit('')
+        self.declared.append(('global', name))
+
+    def function(self, index):
+        name = 'f%d' % index
+        self.emit('int %s(int v0)' % name)
+        self.emit('{')
+        self.block(0, 'v0', 1)
+        self.emit('return v0;', 1)
+        self.emit('}')
+        self.emit('')
+        self.declared.append(('function', name))
+
+    def generate(self):
+        self.emit('/* gensynth.py --decls %d --depth %d --uses %d --hot %s */'
+                  % (self.decls, self.depth, self.uses, self.hot))
+        self.emit('')
+        for index in xrange(self.decls):
+            kind = index % 6
+            if kind == 0:
+                self.struct(index)
+            elif kind in (1, 2):
+                self.globalVariable(index)
+            else:
+                self.function(index)
+
+        self.emit('int main()')
+        self.emit('{')
+        self.emit('int v0 = 0;', 1)
+        for kind, name in self.declared[-self.uses:]:
+            if kind == 'function':
+                self.emit('v0 += %s(v0);' % name, 1)
+        self.emit('return v0;', 1)
+        self.emit('}')
+        return '\n'.join(self.lines) + '\n'
+
+
+def generate(decls, depth=2, uses=3, hot=0.0, seed=0):
+    return Generator(decls, depth, uses, hot, seed).generate()
+
+
+def main(argv=None):
+    if argv is None:
+        argv = sys.argv
+
+    parser = optparse.OptionParser(usage='%prog [options] [<fileName>]')
+    parser.add_option('-n', '--decls', type='int', default=100,
+                      help = 'number of top-level declarations')
+    parser.add_option('-d', '--depth', type='int', default=2,
+                      help = 'nesting depth of function bodies')
+    parser.add_option('-u', '--uses', type='int', default=3,
+                      help = 'uses of earlier declarations per block')
+    parser.add_option('--hot', type='float', default=0.0,
+                      help = 'fraction of uses that go to the first few declarations')
+    parser.add_option('-s', '--seed', type='int', default=0,
+                      help = 'random seed')
+
+    options, args = parser.parse_args(argv[1:])
+    if len(args) > 1:
+        parser.error('wrong number of positional arguments')
+
+    text = generate(options.decls, options.depth, options.uses, options.hot,
+                    options.seed)
+    if args:
+        f = open(args[0], 'w')
+        f.write(text)
+        f.close()
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()
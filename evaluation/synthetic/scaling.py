@@ -0,0 +1,230 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""How constraint generation and solving scale with the shape of the input.
+
+For every point of the sweep a synthetic file is generated with gensynth.py
+and measured in a directory of its own:
+
+    GEN         wall seconds of GenerateConstraints
+    GENRSS      its peak resident set size in KB
+    LOAD        seconds to consult load.pl, i.e. the facts and the rules
+    LABEL       seconds of clearAllLabels(L), the first query of a run
+    ITERATION   mean seconds of one phase 1 step of the solver: pick a node
+                with topScoringRemovableWUDR, compute its transitive deletion
+                and delete it
+
+The last columns give, for each timing, the growth exponent from the
+previous point, log(t2/t1) / log(n2/n1) with n the number of nodes. Around
+1 is linear; exponents of 1.7 and more are marked with a *, that is where
+the quadratic behaviours are.
+
+The solver runs in a child process per point, since pyswip has one Prolog
+engine per process.
+"""
+
+from __future__ import with_statement
+
+import math
+import optparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from gensynth import generate
+
+here = os.path.dirname(os.path.abspath(__file__))
+solverFiles = ['load.pl', 'inferenceRules.pl', 'utils.pl']
+
+# what a sweep varies, and the shape it starts from
+defaultShape = {'decls': 100, 'depth': 2, 'uses': 3, 'hot': 0.0}
+defaultSweeps = {'decls': '50,100,200,400,800',
+                 'depth': '1,2,4,8',
+                 'uses': '1,2,4,8,16',
+                 'hot': '0.0,0.25,0.5,0.75,1.0'}
+timings = ['GEN', 'LOAD', 'LABEL', 'ITERATION']
+# growth exponents from here up are marked with a *
+quadratic = 1.7
+
+
+def formatted(value):
+    if isinstance(value, float):
+        return '%.4f' % value
+    return str(value)
+
+
+def runGenerator(generator, directory, fileName):
+    """Wall seconds and peak RSS in KB of generating constraints."""
+    devnull = open(os.devnull, 'w')
+    start = time.time()
+    process = subprocess.Popen([generator, '-plugin', 'gen-constraints',
+                                fileName], cwd=directory, stdout=devnull,
+                               stderr=devnull)
+    pid, status, usage = os.wait4(process.pid, 0)
+    seconds = time.time() - start
+    devnull.close()
+    return seconds, usage.ru_maxrss
+
+
+def countNodes(factsFileName):
+    nodes = 0
+    with open(factsFileName) as f:
+        for line in f:
+            if line.startswith('sourceRange('):
+                nodes += 1
+    return nodes
+
+
+def measureSolver(directory, iterations):
+    """Runs in the child: prints LOAD, LABEL and ITERATION lines."""
+    from pyswip import Prolog
+
+    os.chdir(directory)
+    prolog = Prolog()
+
+    def query(q):
+        return list(prolog.query(q, maxresult=1))
+
+    start = time.time()
+    prolog.consult('load.pl')
+    print "LOAD %f" % (time.time() - start)
+
+    start = time.time()
+    query("clearAllLabels(L)")
+    print "LABEL %f" % (time.time() - start)
+
+    steps = []
+    for i in xrange(iterations):
+        start = time.time()
+        result = query("topScoringRemovableWUDR(X)")
+        if not result:
+            break
+        symbol = str(result[0]['X'])
+        query("recursivelyComputeDeletionAction(%s, L1, L2)" % symbol)
+        query("delete(%s)" % symbol)
+        steps.append(time.time() - start)
+    if steps:
+        print "ITERATION %f" % (sum(steps) / len(steps))
+
+
+def runSolver(directory, iterations):
+    output = subprocess.Popen([sys.executable, os.path.abspath(__file__),
+                               '--measureSolver', directory,
+                               '--iterations', str(iterations)],
+                              stdout=subprocess.PIPE).communicate()[0]
+    measurements = {}
+    for line in output.splitlines():
+        words = line.split()
+        if len(words) == 2 and words[0] in timings:
+            measurements[words[0]] = float(words[1])
+    return measurements
+
+
+def measure(shape, options):
+    directory = tempfile.mkdtemp(prefix='scaling-')
+    try:
+        fileName = 'synth.c'
+        text = generate(shape['decls'], shape['depth'], shape['uses'],
+                        shape['hot'], options.seed)
+        with open(os.path.join(directory, fileName), 'w') as f:
+            f.write(text)
+
+        row = {'LINES': text.count('\n')}
+        row['GEN'], row['GENRSS'] = runGenerator(options.generator,
+                                                 directory, fileName)
+        factsFileName = os.path.join(directory, 'out.txt')
+        if not os.path.exists(factsFileName):
+            return row
+        row['NODES'] = countNodes(factsFileName)
+
+        for name in solverFiles:
+            os.symlink(os.path.join(options.solverDir, name),
+                       os.path.join(directory, name))
+        row.update(runSolver(directory, options.iterations))
+        return row
+    finally:
+        if options.keep:
+            print >> sys.stderr, "kept %s" % directory
+        else:
+            shutil.rmtree(directory)
+
+
+def growth(previous, row, column):
+    if previous is None or not previous.get('NODES') or not row.get('NODES'):
+        return '-'
+    if previous['NODES'] == row['NODES']:
+        return '-'
+    if not previous.get(column) or not row.get(column):
+        return '-'
+    exponent = (math.log(row[column] / previous[column]) /
+                math.log(float(row['NODES']) / previous['NODES']))
+    return '%.2f%s' % (exponent, exponent >= quadratic and '*' or '')
+
+
+def main(argv=None):
+    if argv is None:
+        argv = sys.argv
+
+    parser = optparse.OptionParser(usage='%prog [options]')
+    parser.add_option('-g', '--generator',
+                      default=os.path.join(here, '..', '..', 'bin',
+                                           'GenerateConstraints'),
+                      help = 'the GenerateConstraints binary')
+    parser.add_option('--solverDir',
+                      default=os.path.join(here, '..', '..', 'src',
+                                           'constraintSolver', 'swipl'),
+                      help = 'where load.pl and the rules are')
+    parser.add_option('--sweep', default='decls',
+                      help = 'what to vary: %s' % ', '.join(sorted(defaultSweeps)))
+    parser.add_option('--values', default=None,
+                      help = 'comma separated values of the swept parameter')
+    for name, value in sorted(defaultShape.items()):
+        parser.add_option('--%s' % name, type=type(value).__name__,
+                          default=value,
+                          help = 'fixed %s when not swept' % name)
+    parser.add_option('-i', '--iterations', type='int', default=10,
+                      help = 'solver steps to average over')
+    parser.add_option('-s', '--seed', type='int', default=0,
+                      help = 'random seed of the generator')
+    parser.add_option('--keep', action='store_true', default=False,
+                      help = 'keep the working directories')
+    parser.add_option('--measureSolver', default=None,
+                      help = optparse.SUPPRESS_HELP)
+
+    options, args = parser.parse_args(argv[1:])
+    if args:
+        parser.error('wrong number of positional arguments')
+
+    if options.measureSolver is not None:
+        measureSolver(options.measureSolver, options.iterations)
+        return
+
+    if options.sweep not in defaultSweeps:
+        parser.error('cannot sweep %s' % options.sweep)
+    options.generator = os.path.abspath(options.generator)
+    options.solverDir = os.path.abspath(options.solverDir)
+    valueType = type(defaultShape[options.sweep])
+    values = [valueType(v) for v in
+              (options.values or defaultSweeps[options.sweep]).split(',')]
+
+    columns = ['LINES', 'NODES', 'GEN', 'GENRSS', 'LOAD', 'LABEL',
+               'ITERATION']
+    print '\t'.join([options.sweep.upper()] + columns +
+                    ['d%s' % t for t in timings])
+    previous = None
+    for value in values:
+        shape = dict([(name, getattr(options, name)) for name in defaultShape])
+        shape[options.sweep] = value
+        row = measure(shape, options)
+        print '\t'.join([str(value)] +
+                        [formatted(row.get(c, '-')) for c in columns] +
+                        [growth(previous, row, t) for t in timings])
+        sys.stdout.flush()
+        previous = row
+
+
+if __name__ == '__main__':
+    main()
@@ -28,12 +28,17 @@ allElements(L) :- safeSetOf(X, isElement(X), L).
 clearLabel(X) :- retractall(hasBeenDeleted(X)),
 	retractall(hasBeenPermanentlyDeleted(X)),
 	retractall(hasUntrackedDependency(X)),
-	retractall(isEssentialForFailure(X)).
-clearAllLabels(L) :- allElements(L), maplist(clearLabel, L).
-%% valid to remove
-isRemovable(X) :- replaceWith(X, _), sourceRange(X, _, _, _),
-	not(hasBeenPermanentlyDeleted(X)), not(isEssentialForFailure(X)),
-	not(isInvalid(X)), not(isMain(X)).
+	retractall(isEssentialForFailure(X)),
+	retractall(removableNode(X)),
+	( isRemovableCandidate(X) -> assert(removableNode(X)); true ).
+clearAllLabels(L) :- retractall(removableNode(_)), allElements(L),
+	maplist(clearLabel, L).
+%% valid to remove, ignoring labels
+isRemovableCandidate(X) :- replaceWith(X, _), sourceRange(X, _, _, _),
+	not(isInvalid(X)), not(isMain(X)), !.
+%% valid to remove. removableNode/1 is kept up to date by the label
+%% assertions below, so this doesn't re-check every label on every call
+isRemovable(X) :- removableNode(X).
 
 %% finer level dependencies
 explicitDependsOn(X, Y) :- dependsOn(X, Y), not(containedWithin(X, Y)).
@@ -84,8 +89,16 @@ allDependsOnWorker([H|T], PL, L) :- expandCurrentFrontierBackward([H|T], CF1),
 	allDependsOnWorker(NF, PL1, L).
 allDependsOn(X, L) :- allDependsOnWorker([X], [], L1), ord_subtract(L1, [X],
 	L2), include(isRemovable, L2, L).
+%% like allDependingOn, but keeps essential nodes (phase 2 still removes those)
+allLiveDependingOn(X, L) :- allDependingOnWorker([X], [], L1), ord_subtract(L1,
+	[X], L2), exclude(hasBeenPermanentlyDeleted, L2, L).
 
 
+%% the whole implicit dependency graph, for building a reachability index
+%% outside of prolog
+allImplicitDependencies(L) :- findall(dependency(X, Y), implicitDependsOn(X, Y),
+	L1), sort(L1, L).
+
 %% transitiveImplicitLiveDependsOn(X, Y) :- implicitLiveDependsOn(X, Y).
 %% transitiveImplicitLiveDependsOn(X, Y) :- implicitLiveDependsOn(X, Z),
 %% 	transitiveImplicitLiveDependsOn(Z, Y).
@@ -105,8 +118,10 @@ isBottomLevel(X) :- allDependingOn(X, L1), filterOutContainedWithin(X, L1, [], L
 
 assertDeletion(X) :- assert(hasBeenDeleted(X)).
 assertUndoDeletion(X) :- retractall(hasBeenDeleted(X)).
-assertPermanentDeletion(X) :- assert(hasBeenPermanentlyDeleted(X)), retractall(hasBeenDeleted(X)).
-assertIsEssentialForFailure(X) :- assert(isEssentialForFailure(X)).
+assertPermanentDeletion(X) :- assert(hasBeenPermanentlyDeleted(X)), retractall(hasBeenDeleted(X)),
+	retractall(removableNode(X)).
+assertIsEssentialForFailure(X) :- assert(isEssentialForFailure(X)),
+	retractall(removableNode(X)).
 assertHasUntrackedDependency(X) :- assert(hasUntrackedDependency(X)).
 
 recursivelyDelete(X) :- transitiveRemovalList(X, L), maplist(assertDeletion, L).
@@ -124,10 +139,22 @@ recursivelyMarkEssential(X) :- assertIsEssentialForFailure(X), allDependsOn(X,
 	L1), exclude(isEssentialForFailure, L1, L),
 	maplist(assertIsEssentialForFailure, L).
 
+%% same as above, but also return the nodes whose labels changed so that the
+%% driver can keep its own label store in sync
+permanentlyDelete(X, L) :- ( isRemovable(X) -> transitiveRemovalList(X, L),
+	maplist(assertPermanentDeletion, L); L = [] ).
+recursivelyMarkEssential(X, [X|L]) :- allDependsOn(X, L1),
+	exclude(isEssentialForFailure, L1, L), assertIsEssentialForFailure(X),
+	maplist(assertIsEssentialForFailure, L).
+
 
 deleteList(L) :- maplist(assertDeletion, L).
 undoDeleteList(L) :- maplist(assertUndoDeletion, L).
 permanentlyDeleteList(L) :- maplist(assertPermanentDeletion, L).
+markEssentialList(L) :- maplist(assertIsEssentialForFailure, L).
+markUntrackedList(L) :- maplist(assertHasUntrackedDependency, L).
+allPermanentlyDeleted(L) :- safeSetOf(X, hasBeenPermanentlyDeleted(X), L).
+allEssentialForFailure(L) :- safeSetOf(X, isEssentialForFailure(X), L).
 
 %% source range metric. is flawed, not sure if that reall matters though.
 sourceRangeSize(X, NumChar) :- sourceRange(X, B, E, _), NumChar is E - B.
@@ -226,11 +253,18 @@ sortSourceRangeSize(Order, Term1, Term2) :- sourceRangeSize(Term1, T1Size),
 	( T1Size == T2Size -> compare(Order, Term1, Term2);
 	    compare(Order, T2Size, T1Size)).
 
+%% outer ranges before the ranges nested in them
+sortSourceRangeBegin(Order, Term1, Term2) :- sourceRange(Term1, B1, E1, _),
+	sourceRange(Term2, B2, E2, _),
+	( B1 == B2 -> ( E1 == E2 -> compare(Order, Term1, Term2);
+		compare(Order, E2, E1));
+	    compare(Order, B1, B2)).
+
 %% containedWithinList(X, Y) :- safeSetOf(Z, containedWithin(Z, Y), X).
 %% containedWithinListSorted(X, Y) :- safeSetOf(Z, containedWithin(Z, Y), L),
 %% 	predsort(sourceRangeCompare, L, X).
 
-allRemovable(L) :- safeSetOf(X, isRemovable(X), L).
+allRemovable(L) :- safeSetOf(X, removableNode(X), L).
 allRemovableWUD(L) :- setof(X, isRemovable(X), L1),
 	exclude(hasUntrackedDependency, L1, L).
 allRemovableDeleted(L) :- safeSetOf(X, isRemovable(X), L1),
@@ -246,6 +280,9 @@ allUntrackedDependencies(L) :- safeSetOf(X, hasUntrackedDependency(X), S),
 allNotPermanentlyDeleted(L) :- allRemovable(L1), safeSetOf(X,
 	isEssentialForFailure(X), S), merge_set(L1, S, L2),
 	predsort(sortSourceRangeSize, L2, L).
+allNotPermanentlyDeletedInSourceOrder(L) :- allRemovable(L1), safeSetOf(X,
+	isEssentialForFailure(X), S), merge_set(L1, S, L2),
+	predsort(sortSourceRangeBegin, L2, L).
 
 topScoringRemovable(X) :- allRemovable(L), !,
 	findMin(sortAllDependsOnDescAllDependingOnDesc, L, X), !.
@@ -258,6 +295,9 @@ topScoringRemovableWUDA(X) :- allRemovableWUD(L), !,
 topScoringRemovableWUDR(X) :- allRemovableWUD(L), !, choose(L, X), !.
 topScoringRemovableWUD2(X) :- allRemovableWUD(L), !,
 	findMin(sortAllDependsOnDescAllDependingOnDesc, L, X), !.
+%% the same heuristics over the removable nodes the driver keeps itself
+topScoringAmong(random, L, X) :- choose(L, X), !.
+topScoringAmong(C, L, X) :- findMin(C, L, X), !.
 topScoringRemovableDeleted(X) :- allRemovableDeleted(L), !,
 	findMin(sortAllDependsOnDescAllDependingOnDesc, L, X), !.
 topScoringRemovableDeletedWUD(X) :- allRemovableDeletedWUD(L), !,
@@ -266,6 +306,63 @@ topScoringRemovableDeletedWUD2(X) :- allRemovableDeletedWUD(L), !,
 	findMin(sortAllDependsOnDescAllDependingOnDesc, L, X), !.
 
 
+%% hierarchical schedule: top-level declarations first, then statements and
+%% nested declarations, then expressions. nesting comes from the source ranges
+strictlyContainedWithin(X, Y) :- containedWithin(X, Y), X \== Y,
+	not(containedWithin(Y, X)).
+isNested(X) :- strictlyContainedWithin(X, _).
+isTopLevelDeclaration(X) :- isDeclaration(X), not(isNested(X)).
+reductionLevel(X, N) :- ( isTopLevelDeclaration(X) -> N = 0;
+	isExpr(X) -> N = 2; N = 1 ).
+isAtReductionLevel(N, X) :- reductionLevel(X, N).
+reductionLevelOf(X, level(X, N)) :- reductionLevel(X, N).
+allReductionLevels(L) :- allElements(L1), maplist(reductionLevelOf, L1, L).
+allRemovableWUDAtLevel(N, L) :- allRemovableWUD(L1),
+	include(isAtReductionLevel(N), L1, L).
+topScoringRemovableWUDAtLevel(N, X) :- allRemovableWUDAtLevel(N, L), !,
+	findMin(sortAllDependingOnDescAllDependsOnDesc, L, X), !.
+
+%% static node features for the adaptive ordering in the driver
+nodeKind(X, K) :- ( isExpr(X) -> K = expr;
+	isCondition(X) -> K = condition;
+	isInitializer(X) -> K = initializer;
+	isCompoundStatement(X) -> K = compoundStatement;
+	isStatement(X) -> K = statement;
+	K = declaration ).
+nestingDepth(X, D) :- safeSetOf(Y, strictlyContainedWithin(X, Y), L),
+	length(L, D).
+nodeFeatures(X, features(X, K, D, S)) :- nodeKind(X, K), nestingDepth(X, D),
+	sourceRangeSize(X, S), !.
+allNodeFeatures(L) :- allElements(L1), maplist(nodeFeatures, L1, L).
+
+transitiveRemovalSizeTerm(X, size(X, N)) :- transitiveRemovalSize(X, N), !.
+allTransitiveRemovalSizes(L) :- allRemovable(L1),
+	maplist(transitiveRemovalSizeTerm, L1, L).
+%% labelling the nodes L changes the removal lists of the nodes they depend on,
+%% only; their new sizes
+transitiveRemovalSizesAbove(L, S) :- sort(L, L1), allDependsOnWorker(L1, [],
+	L2), include(isRemovable, L2, L3), maplist(transitiveRemovalSizeTerm, L3,
+	S).
+
+%% crash locality: top level declarations whose removal doesn't take a
+%% function called Name (the one the compiler crashed in) with it
+removesFunctionNamed(Name, X) :- transitiveRemovalList(X, L), member(Y, L),
+	hasName(Y, Name), !.
+isUnrelatedToFunction(Name, X) :- isRemovable(X), isTopLevelDeclaration(X),
+	not(removesFunctionNamed(Name, X)).
+allUnrelatedToFunction(Name, L) :- allRemovable(L1),
+	include(isUnrelatedToFunction(Name), L1, L).
+
+%% sweeps: top level declarations nothing live refers to, and the bodies of
+%% the functions other than main and the one called Name
+isDeadDeclaration(X) :- isTopLevelDeclaration(X), allLiveDependingOn(X, L1),
+	filterOutContainedWithin(X, L1, [], []).
+allDeadDeclarations(L) :- allRemovable(L1), include(isDeadDeclaration, L1, L).
+isStubbableBody(Name, X) :- hasBody(F, X), isRemovable(X), not(isMain(F)),
+	not(hasName(F, Name)).
+allStubbableBodies(Name, L) :- allRemovable(L1),
+	include(isStubbableBody(Name), L1, L).
+
 markAllUntrackedDependencies(L) :- allRemovable(L),
 	maplist(assertHasUntrackedDependency, L).
 
@@ -275,6 +372,43 @@ computeDeletionAction(X, (B, E, R)) :- sourceRange(X, B, E, _), replaceWith(X,
 computeDeletionActionForList(L, L1) :- maplist(computeDeletionAction, L, L1), !.
 recursivelyComputeDeletionAction(X, L1, L2) :- transitiveRemovalList(X, L1),!,
 	maplist(computeDeletionAction, L1, L2), !.
+%% same as above but for a batch of roots removed together
+transitiveRemovalListForListWorker([], L, L).
+transitiveRemovalListForListWorker([H|T], PL, L) :- transitiveRemovalList(H,
+	L1), merge_set(L1, PL, PL1), transitiveRemovalListForListWorker(T, PL1, L).
+transitiveRemovalListForList(X, L) :- transitiveRemovalListForListWorker(X, [],
+	L).
+recursivelyComputeDeletionActionForList(X, L1, L2) :-
+	transitiveRemovalListForList(X, L1), !,
+	maplist(computeDeletionAction, L1, L2), !.
+%% top-k batch: the K best of the nodes L by the score of
+%% topScoringRemovableWUD, best first, as cand(X, RemovalList, Actions).
+%% every node is walked once and ranked by keysort instead of predsort, which
+%% walks both nodes of every comparison; ties go to the greater symbol, as in
+%% sortAllDependingOnDescAllDependsOnDesc, hence the reversed input
+removalOf(X, removal(X, R)) :- allDependingOnWorker([X], [X], L1),
+	include(isRemovable, L1, R).
+candidateKey(X, k(NDO, NDS)-removal(X, R)) :- removalOf(X, removal(X, R)),
+	ord_subtract(R, [X], DO), length(DO, DOlen), allDependsOn(X, DS),
+	length(DS, DSlen), NDO is -DOlen, NDS is -DSlen.
+removalCandidate(_-removal(X, R), cand(X, R, A)) :-
+	maplist(computeDeletionAction, R, A), !.
+nodeCandidate(X, C) :- removalOf(X, R), removalCandidate(_-R, C).
+firstN(0, _, []) :- !.
+firstN(_, [], []) :- !.
+firstN(N, [H|T], [H|T1]) :- N1 is N - 1, firstN(N1, T, T1).
+topKCandidates(L, K, C) :- sort(L, L1), reverse(L1, L2),
+	maplist(candidateKey, L2, KL), keysort(KL, SL), firstN(K, SL, TL),
+	maplist(removalCandidate, TL, C), !.
+topKCandidates(K, C) :- allRemovableWUD(L), !, topKCandidates(L, K, C).
+%% the same by the comparator of another heuristic (see topScoringAmong/3);
+%% random takes L in the order it comes
+topKCandidates(sortAllDependingOnDescAllDependsOnDesc, L, K, C) :- !,
+	topKCandidates(L, K, C).
+topKCandidates(random, L, K, C) :- !, firstN(K, L, TL),
+	maplist(nodeCandidate, TL, C), !.
+topKCandidates(Cmp, L, K, C) :- predsort(Cmp, L, SL), firstN(K, SL, TL),
+	maplist(nodeCandidate, TL, C), !.
 transitiveRemovalListSorted(X, L) :- transitiveRemovalList(X, L1), !,
 	predsort(sortAllDependsOnDescAllDependingOnDesc, L1, L).
 transitiveRemovalListWUD(X, L) :- transitiveRemovalList(X, L1), !,
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CompilerTest.hpp"
+#include "DDMin.hpp"
+
+// The character-level baseline of evaluation/gcc-tests/ddmin/GCCDD.py on the
+// C++ ddmin: every character of the input is a delta, outcomes are cached,
+// and with -j several candidates are compiled at once. Writes the 1-minimal
+// input to OUTPUT (FILE_min by default).
+
+using namespace ddmin;
+
+namespace
+{
+  class CharacterOracle
+  {
+  public:
+    CharacterOracle(const std::string & inputText,
+                    const std::string & inputFileName,
+                    const std::string & testCommand)
+      :input(inputText),
+       fileName(inputFileName),
+       command(testCommand)
+    {
+    }
+
+    std::string render(const std::vector<size_t> & c) const
+    {
+      std::string text;
+      text.reserve(c.size());
+      for (size_t i = 0; i < c.size(); ++i)
+      {
+        text += input[c[i]];
+      }
+      return text;
+    }
+
+    Outcome operator()(const std::vector<size_t> & c, size_t slot)
+    {
+      std::string candidate = slotFileName(fileName, slot);
+      if (!writeFile(candidate, render(c)))
+        return UNRESOLVED;
+      return runCompiler(command, candidate);
+    }
+
+  private:
+    const std::string & input;
+    std::string fileName;
+    std::string command;
+  };
+
+  template <class Executor>
+  int reduce(CharacterOracle & oracle, size_t size,
+             const std::string & outputFileName, const Executor & executor)
+  {
+    std::vector<size_t> c;
+    for (size_t i = 0; i < size; ++i)
+    {
+      c.push_back(i);
+    }
+
+    DDMin<size_t, CharacterOracle, UniformSplit, OutcomeCache<size_t>,
+          Executor> dd(oracle, UniformSplit(), OutcomeCache<size_t>(),
+                       executor);
+    std::vector<size_t> minimal = dd.minimize(c);
+
+    if (!writeFile(outputFileName, oracle.render(minimal)))
+    {
+      std::cerr << "cannot write " << outputFileName << "\n";
+      return 1;
+    }
+    std::cout << "The 1-minimal failure-inducing input is\n"
+              << oracle.render(minimal) << "\n";
+    printStatistics(std::cout, dd.statistics());
+    return 0;
+  }
+
+  void usage()
+  {
+    std::cerr << "usage: CharDD [-j JOBS] [-o OUTPUT] FILE COMMAND...\n";
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  size_t jobs = 1;
+  std::string outputFileName;
+
+  // stop at FILE: the options after it are the test command's
+  int option;
+  while ((option = getopt(argc, argv, "+j:o:")) != -1)
+  {
+    switch (option)
+    {
+      case 'j':
+        jobs = atoi(optarg);
+        break;
+      case 'o':
+        outputFileName = optarg;
+        break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+  if (argc - optind < 2)
+  {
+    usage();
+    return 2;
+  }
+
+  std::string inputFileName(argv[optind]);
+  std::string command;
+  for (int i = optind + 1; i < argc; ++i)
+  {
+    command += (command.empty() ? "" : " ") + std::string(argv[i]);
+  }
+  if (outputFileName.empty())
+    outputFileName = inputFileName + "_min";
+
+  std::string input;
+  if (!readFile(inputFileName, input))
+  {
+    std::cerr << "cannot read " << inputFileName << "\n";
+    return 1;
+  }
+
+  CharacterOracle oracle(input, inputFileName, command);
+  if (jobs > 1)
+    return reduce(oracle, input.size(), outputFileName,
+                  ParallelExecutor(jobs));
+  return reduce(oracle, input.size(), outputFileName, SerialExecutor());
+}
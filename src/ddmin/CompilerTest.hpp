@@ -0,0 +1,105 @@
+#ifndef __COMPILER__TEST__HPP
+#define __COMPILER__TEST__HPP
+
+#include <stdio.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "DDMin.hpp"
+
+// Running the compiler under test on a candidate file and judging the run
+// the way outcome.py does:
+//
+//   PASS        the compiler accepted the file without warnings
+//   FAIL        it crashed with an internal compiler error
+//   UNRESOLVED  anything else
+namespace ddmin
+{
+  inline Outcome classifyOutput(int status, const std::string & output)
+  {
+    bool warned = output.find("warning") != std::string::npos;
+    if (status == 0 && !warned)
+      return PASS;
+    if (warned)
+      return UNRESOLVED;
+    if (output.find("internal compiler error") != std::string::npos)
+      return FAIL;
+    return UNRESOLVED;
+  }
+
+  inline Outcome runCompiler(const std::string & command,
+                             const std::string & fileName)
+  {
+    std::string commandLine = command + " " + fileName + " 2>&1";
+    FILE * pipe = popen(commandLine.c_str(), "r");
+    if (pipe == NULL)
+      return UNRESOLVED;
+
+    std::string output;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), pipe)) > 0)
+    {
+      output.append(chunk, n);
+    }
+    return classifyOutput(pclose(pipe), output);
+  }
+
+  inline bool readFile(const std::string & fileName, std::string & contents)
+  {
+    std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!in)
+      return false;
+    std::ostringstream oss;
+    oss << in.rdbuf();
+    contents = oss.str();
+    return true;
+  }
+
+  inline bool writeFile(const std::string & fileName,
+                        const std::string & contents)
+  {
+    std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary);
+    if (!out)
+      return false;
+    out << contents;
+    return out.good();
+  }
+
+  // Where concurrent tests write their candidates: slot<N>-<base name>, in
+  // the working directory, keeping the extension the compiler goes by.
+  inline std::string slotFileName(const std::string & fileName, size_t slot)
+  {
+    std::string base = fileName.substr(fileName.rfind('/') + 1);
+    std::ostringstream oss;
+    oss << "slot" << slot << "-" << base;
+    return oss.str();
+  }
+
+  inline const char * outcomeName(Outcome outcome)
+  {
+    switch (outcome)
+    {
+      case PASS:
+        return "PASS";
+      case FAIL:
+        return "FAIL";
+      default:
+        return "UNRESOLVED";
+    }
+  }
+
+  inline void printStatistics(std::ostream & os, const Statistics & stats)
+  {
+    os << "ROUNDS: " << stats.rounds << "\n"
+       << "CACHEHITS: " << stats.cacheHits << "\n"
+       << "NUMBEROFUNRESOLVEDTESTS: " << stats.unresolved << "\n"
+       << "TOTALTESTS: " << stats.tests << "\n";
+    if (stats.timedOut)
+      os << "TIMEDOUT\n";
+  }
+}
+
+#endif // __COMPILER__TEST__HPP
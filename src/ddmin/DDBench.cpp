@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CompilerTest.hpp"
+#include "DDMin.hpp"
+
+// Microbenchmark of the ddmin core on the characters of the given files,
+// without a compiler: a configuration FAILs iff it still has every one of
+// TARGETS characters spread evenly over the file. This measures what the
+// algorithm itself costs per test. evaluation/gcc-tests/ddmin/benchDD.py
+// runs DD.py with the same oracle and prints the same columns.
+
+using namespace ddmin;
+
+namespace
+{
+  class SyntheticOracle
+  {
+  public:
+    SyntheticOracle(size_t size, size_t targets)
+    {
+      size_t stride = std::max(size / std::max(targets, (size_t) 1),
+                               (size_t) 1);
+      for (size_t i = 0; i < size; i += stride)
+      {
+        failureInducing.push_back(i);
+      }
+    }
+
+    Outcome operator()(const std::vector<size_t> & c, size_t slot)
+    {
+      for (size_t i = 0; i < failureInducing.size(); ++i)
+      {
+        if (!std::binary_search(c.begin(), c.end(), failureInducing[i]))
+          return PASS;
+      }
+      return FAIL;
+    }
+
+  private:
+    std::vector<size_t> failureInducing;
+  };
+
+  template <class Cache>
+  void bench(const std::string & fileName, const std::string & variant,
+             size_t size, size_t targets, size_t repeat)
+  {
+    std::vector<size_t> c;
+    for (size_t i = 0; i < size; ++i)
+    {
+      c.push_back(i);
+    }
+
+    double best = -1;
+    Statistics stats;
+    size_t minimal = 0;
+    for (size_t r = 0; r < repeat; ++r)
+    {
+      SyntheticOracle oracle(size, targets);
+      DDMin<size_t, SyntheticOracle, UniformSplit, Cache> dd(oracle);
+      double start = now();
+      minimal = dd.minimize(c).size();
+      double seconds = now() - start;
+      if (best < 0 || seconds < best)
+        best = seconds;
+      stats = dd.statistics();
+    }
+
+    std::cout << fileName << "\t" << size << "\t" << variant << "\t"
+              << minimal << "\t" << stats.tests << "\t" << best << "\n";
+  }
+
+  void usage()
+  {
+    std::cerr << "usage: DDBench [-t TARGETS] [-r REPEAT] FILE...\n";
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  size_t targets = 8;
+  size_t repeat = 3;
+
+  int option;
+  while ((option = getopt(argc, argv, "t:r:")) != -1)
+  {
+    switch (option)
+    {
+      case 't':
+        targets = atoi(optarg);
+        break;
+      case 'r':
+        repeat = atoi(optarg);
+        break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+  if (optind == argc)
+  {
+    usage();
+    return 2;
+  }
+
+  std::cout << "FILE\tDELTAS\tVARIANT\tMINIMAL\tTESTS\tSECONDS\n";
+  for (int i = optind; i < argc; ++i)
+  {
+    std::string contents;
+    if (!readFile(argv[i], contents))
+    {
+      std::cerr << "cannot read " << argv[i] << "\n";
+      continue;
+    }
+    bench<NoCache>(argv[i], "c++", contents.size(), targets, repeat);
+    bench<OutcomeCache<size_t> >(argv[i], "c++-cache", contents.size(),
+                                 targets, repeat);
+  }
+  return 0;
+}
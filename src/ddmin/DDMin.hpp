@@ -0,0 +1,560 @@
+#ifndef __DD__MIN__HPP
+#define __DD__MIN__HPP
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+// Zeller's ddmin over a vector of deltas, with the parts that differ between
+// our uses picked at compile time:
+//
+//   Oracle       Outcome operator()(const std::vector<Delta> & c, size_t slot)
+//                tests configuration C. SLOT is below the executor's width
+//                and tells concurrent tests apart (e.g. which file to write).
+//   SplitPolicy  how a configuration is cut into n subsets to remove
+//                (UniformSplit, SizeWeightedSplit, DependencyClosedSplit).
+//   CachePolicy  whether outcomes of configurations are remembered
+//                (NoCache, OutcomeCache).
+//   Executor     how the complements of a round are tested
+//                (SerialExecutor, ParallelExecutor).
+//
+// The result does not depend on the executor: a parallel round still takes
+// the first failing complement in split order, as a serial one would.
+//
+// With a deadline, minimize stops starting tests once it has passed and
+// returns the smallest failing configuration found so far.
+namespace ddmin
+{
+  // Seconds since the epoch.
+  inline double now()
+  {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+  }
+
+  enum Outcome
+  {
+    PASS, FAIL, UNRESOLVED
+  };
+
+  const size_t NONE = static_cast<size_t>(-1);
+
+  // Subsets are given as increasing indices into the configuration.
+  typedef std::vector<size_t> Subset;
+  typedef std::vector<Subset> Subsets;
+
+  // N contiguous slices whose sizes differ by at most one, as split.py does.
+  struct UniformSplit
+  {
+    template <class Delta>
+    void operator()(const std::vector<Delta> & c, size_t n,
+                    Subsets & subsets) const
+    {
+      size_t start = 0;
+      for (size_t i = 0; i < n; ++i)
+      {
+        size_t length = static_cast<size_t>(
+          (c.size() - start) / static_cast<double>(n - i) + 0.5);
+        Subset subset;
+        for (size_t j = start; j < start + length; ++j)
+        {
+          subset.push_back(j);
+        }
+        if (!subset.empty())
+        {
+          subsets.push_back(subset);
+        }
+        start += length;
+      }
+    }
+  };
+
+  // N contiguous slices of about the same total weight, so that one large
+  // delta (a whole function, say) doesn't end up in a slice with half of
+  // everything else. Weigh is size_t operator()(const Delta &) const.
+  template <class Weigh>
+  struct SizeWeightedSplit
+  {
+    SizeWeightedSplit(const Weigh & weighDelta = Weigh())
+      :weigh(weighDelta)
+    {
+    }
+
+    template <class Delta>
+    void operator()(const std::vector<Delta> & c, size_t n,
+                    Subsets & subsets) const
+    {
+      double remaining = 0;
+      for (size_t j = 0; j < c.size(); ++j)
+      {
+        remaining += weigh(c[j]);
+      }
+
+      size_t start = 0;
+      for (size_t i = 0; i < n && start < c.size(); ++i)
+      {
+        double target = remaining / (n - i);
+        // every later slice needs at least one delta
+        size_t last = c.size() - (n - i - 1);
+        Subset subset;
+        double weight = 0;
+        size_t j = start;
+        do
+        {
+          weight += weigh(c[j]);
+          subset.push_back(j);
+          ++j;
+        } while (j < last && weight + weigh(c[j]) / 2.0 <= target);
+        if (i == n - 1)
+        {
+          for (; j < c.size(); ++j)
+          {
+            subset.push_back(j);
+          }
+        }
+        subsets.push_back(subset);
+        remaining -= weight;
+        start = j;
+      }
+    }
+
+    Weigh weigh;
+  };
+
+  // Like UniformSplit, but every subset also takes everything in the
+  // configuration that depends on one of its deltas, transitively, so that
+  // removing it never leaves a dangling use behind. Subsets may overlap;
+  // ones that would remove everything or repeat an earlier one are dropped.
+  // This is splitClosed() of the driver.
+  template <class Delta>
+  class DependencyClosedSplit
+  {
+  public:
+    void addDependency(const Delta & used, const Delta & user)
+    {
+      dependents[used].push_back(user);
+    }
+
+    void operator()(const std::vector<Delta> & c, size_t n,
+                    Subsets & subsets) const
+    {
+      std::map<Delta, size_t> indexOf;
+      for (size_t j = 0; j < c.size(); ++j)
+      {
+        indexOf[c[j]] = j;
+      }
+
+      Subsets slices;
+      UniformSplit()(c, n, slices);
+
+      std::set<Subset> seen;
+      for (size_t i = 0; i < slices.size(); ++i)
+      {
+        std::vector<bool> closed(c.size(), false);
+        std::vector<size_t> work(slices[i]);
+        for (size_t k = 0; k < work.size(); ++k)
+        {
+          closed[work[k]] = true;
+        }
+        while (!work.empty())
+        {
+          size_t j = work.back();
+          work.pop_back();
+
+          typename Dependents::const_iterator users = dependents.find(c[j]);
+          if (users == dependents.end())
+          {
+            continue;
+          }
+          for (size_t u = 0; u < users->second.size(); ++u)
+          {
+            typename std::map<Delta, size_t>::const_iterator
+              user = indexOf.find(users->second[u]);
+            if (user != indexOf.end() && !closed[user->second])
+            {
+              closed[user->second] = true;
+              work.push_back(user->second);
+            }
+          }
+        }
+
+        Subset subset;
+        for (size_t j = 0; j < c.size(); ++j)
+        {
+          if (closed[j])
+          {
+            subset.push_back(j);
+          }
+        }
+        if (subset.size() == c.size() || !seen.insert(subset).second)
+        {
+          continue;
+        }
+        subsets.push_back(subset);
+      }
+    }
+
+  private:
+    typedef std::map<Delta, std::vector<Delta> > Dependents;
+    Dependents dependents;
+  };
+
+  struct NoCache
+  {
+    template <class Delta>
+    bool lookup(const std::vector<Delta> & c, Outcome & outcome) const
+    {
+      return false;
+    }
+
+    template <class Delta>
+    void store(const std::vector<Delta> & c, Outcome outcome)
+    {
+    }
+  };
+
+  // Remembers the outcome of every configuration tested. Deltas need an
+  // operator<.
+  template <class Delta>
+  class OutcomeCache
+  {
+  public:
+    bool lookup(const std::vector<Delta> & c, Outcome & outcome) const
+    {
+      typename Outcomes::const_iterator it = outcomes.find(c);
+      if (it == outcomes.end())
+      {
+        return false;
+      }
+      outcome = it->second;
+      return true;
+    }
+
+    void store(const std::vector<Delta> & c, Outcome outcome)
+    {
+      outcomes[c] = outcome;
+    }
+
+  private:
+    typedef std::map<std::vector<Delta>, Outcome> Outcomes;
+    Outcomes outcomes;
+  };
+
+  // Test is Outcome operator()(size_t index, size_t slot). Both executors
+  // return the lowest index that FAILs, or NONE.
+  struct SerialExecutor
+  {
+    size_t width() const
+    {
+      return 1;
+    }
+
+    template <class Test>
+    size_t firstFailing(Test & test, size_t count) const
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (test(i, 0) == FAIL)
+        {
+          return i;
+        }
+      }
+      return NONE;
+    }
+  };
+
+  // Runs the tests of a round WIDTH at a time, one thread each. Once a wave
+  // has a failing test the round is over; the tests after the first failing
+  // one in that wave are wasted, which is the price for not waiting on them
+  // one by one.
+  class ParallelExecutor
+  {
+  public:
+    ParallelExecutor(size_t count = 2)
+      :threads(std::max(count, static_cast<size_t>(1)))
+    {
+    }
+
+    size_t width() const
+    {
+      return threads;
+    }
+
+    template <class Test>
+    size_t firstFailing(Test & test, size_t count) const
+    {
+      for (size_t begin = 0; begin < count; begin += threads)
+      {
+        size_t end = std::min(begin + threads, count);
+        std::vector<Task<Test> > tasks(end - begin);
+        std::vector<pthread_t> workers(end - begin);
+        std::vector<bool> started(end - begin, false);
+
+        for (size_t i = begin; i < end; ++i)
+        {
+          Task<Test> & task = tasks[i - begin];
+          task.test = &test;
+          task.index = i;
+          task.slot = i - begin;
+          // the first test of a wave runs on this thread
+          if (i > begin)
+          {
+            started[i - begin] = (pthread_create(&workers[i - begin], NULL,
+                                                 Task<Test>::run, &task) == 0);
+          }
+        }
+        for (size_t i = begin; i < end; ++i)
+        {
+          if (!started[i - begin])
+          {
+            Task<Test>::run(&tasks[i - begin]);
+          }
+        }
+        for (size_t i = begin; i < end; ++i)
+        {
+          if (started[i - begin])
+          {
+            pthread_join(workers[i - begin], NULL);
+          }
+        }
+
+        for (size_t i = begin; i < end; ++i)
+        {
+          if (tasks[i - begin].outcome == FAIL)
+          {
+            return i;
+          }
+        }
+      }
+      return NONE;
+    }
+
+  private:
+    template <class Test>
+    struct Task
+    {
+      Test * test;
+      size_t index;
+      size_t slot;
+      Outcome outcome;
+
+      static void * run(void * self)
+      {
+        Task * task = static_cast<Task *>(self);
+        task->outcome = (*task->test)(task->index, task->slot);
+        return NULL;
+      }
+    };
+
+    size_t threads;
+  };
+
+  struct Statistics
+  {
+    Statistics()
+      :tests(0),
+       cacheHits(0),
+       failing(0),
+       unresolved(0),
+       rounds(0),
+       timedOut(false)
+    {
+    }
+
+    size_t tests;       // oracle calls
+    size_t cacheHits;
+    size_t failing;
+    size_t unresolved;
+    size_t rounds;
+    bool timedOut;      // stopped at the deadline
+  };
+
+  template <class Delta,
+            class Oracle,
+            class SplitPolicy = UniformSplit,
+            class CachePolicy = NoCache,
+            class Executor = SerialExecutor>
+  class DDMin
+  {
+  public:
+    typedef std::vector<Delta> Configuration;
+
+    DDMin(Oracle & testOracle,
+          const SplitPolicy & splitPolicy = SplitPolicy(),
+          const CachePolicy & cachePolicy = CachePolicy(),
+          const Executor & testExecutor = Executor())
+      :oracle(testOracle),
+       split(splitPolicy),
+       cache(cachePolicy),
+       executor(testExecutor),
+       deadline(0)
+    {
+      pthread_mutex_init(&lock, NULL);
+    }
+
+    // Stop at WHEN, in seconds since the epoch; 0 never stops.
+    void stopAt(double when)
+    {
+      deadline = when;
+    }
+
+    ~DDMin()
+    {
+      pthread_mutex_destroy(&lock);
+    }
+
+    // A 1-minimal sub-configuration of C that still FAILs, assuming C does.
+    Configuration minimize(const Configuration & input)
+    {
+      Configuration c(input);
+      size_t n = 2;
+
+      while (c.size() >= 2)
+      {
+        if (pastDeadline())
+        {
+          stats.timedOut = true;
+          break;
+        }
+        ++stats.rounds;
+
+        Subsets subsets;
+        split(c, n, subsets);
+
+        std::vector<Configuration> complements;
+        for (size_t i = 0; i < subsets.size(); ++i)
+        {
+          complements.push_back(complement(c, subsets[i]));
+        }
+
+        ComplementTest tests(*this, complements);
+        size_t failing = executor.firstFailing(tests, complements.size());
+        if (failing != NONE)
+        {
+          c = complements[failing];
+          n = std::max(n - 1, static_cast<size_t>(2));
+          continue;
+        }
+
+        if (n >= c.size())
+        {
+          break;
+        }
+        n = std::min(n * 2, c.size());
+      }
+
+      return c;
+    }
+
+    // Tests C through the cache, as minimize does. Past the deadline a test
+    // that is not cached is UNRESOLVED without running.
+    Outcome test(const Configuration & c, size_t slot = 0)
+    {
+      Outcome outcome;
+      pthread_mutex_lock(&lock);
+      bool cached = cache.lookup(c, outcome);
+      if (cached)
+      {
+        ++stats.cacheHits;
+      }
+      pthread_mutex_unlock(&lock);
+      if (cached)
+      {
+        return outcome;
+      }
+      if (pastDeadline())
+      {
+        return UNRESOLVED;
+      }
+
+      outcome = oracle(c, slot);
+
+      pthread_mutex_lock(&lock);
+      cache.store(c, outcome);
+      ++stats.tests;
+      if (outcome == FAIL)
+      {
+        ++stats.failing;
+      }
+      if (outcome == UNRESOLVED)
+      {
+        ++stats.unresolved;
+      }
+      pthread_mutex_unlock(&lock);
+
+      return outcome;
+    }
+
+    const Statistics & statistics() const
+    {
+      return stats;
+    }
+
+  private:
+    bool pastDeadline() const
+    {
+      return deadline != 0 && now() >= deadline;
+    }
+
+    static Configuration complement(const Configuration & c,
+                                    const Subset & subset)
+    {
+      Configuration rest;
+      rest.reserve(c.size() - subset.size());
+      size_t k = 0;
+      for (size_t j = 0; j < c.size(); ++j)
+      {
+        if (k < subset.size() && subset[k] == j)
+        {
+          ++k;
+          continue;
+        }
+        rest.push_back(c[j]);
+      }
+      return rest;
+    }
+
+    class ComplementTest
+    {
+    public:
+      ComplementTest(DDMin & ddmin,
+                     const std::vector<Configuration> & configurations)
+        :dd(ddmin),
+         complements(configurations)
+      {
+      }
+
+      Outcome operator()(size_t index, size_t slot)
+      {
+        return dd.test(complements[index], slot);
+      }
+
+    private:
+      DDMin & dd;
+      const std::vector<Configuration> & complements;
+    };
+
+    Oracle & oracle;
+    SplitPolicy split;
+    CachePolicy cache;
+    Executor executor;
+    Statistics stats;
+    pthread_mutex_t lock;
+    double deadline;
+  };
+
+  // ddmin(c, oracle) with the defaults: uniform split, no cache, serial.
+  template <class Delta, class Oracle>
+  std::vector<Delta> minimize(const std::vector<Delta> & c, Oracle & oracle)
+  {
+    DDMin<Delta, Oracle> dd(oracle);
+    return dd.minimize(c);
+  }
+}
+
+#endif // __DD__MIN__HPP
@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CompilerTest.hpp"
+#include "DDMin.hpp"
+
+// Phase 2 of the driver (ddmin over the nodes phase 1 left behind) without
+// going back to the solver for every test. The driver writes one line per
+// node with the deletion action the solver computed for it,
+//
+//   symbol begin end [replacement]
+//
+// and a candidate is the input with the actions of the removed nodes applied
+// in that order, the way applyChanges() does it: the range is overwritten
+// with the replacement padded with blanks, so offsets never move.
+//
+// Prints REMOVED <symbol> for every node it took out and writes the reduced
+// file to OUTPUT.
+
+using namespace ddmin;
+
+namespace
+{
+  struct Action
+  {
+    std::string symbol;
+    size_t begin;
+    size_t end;
+    std::string replacement;
+  };
+
+  typedef std::vector<Action> Actions;
+
+  bool readActions(const std::string & fileName, Actions & actions)
+  {
+    std::string contents;
+    if (!readFile(fileName, contents))
+      return false;
+
+    std::istringstream lines(contents);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+      std::istringstream fields(line);
+      Action action;
+      if (!(fields >> action.symbol >> action.begin >> action.end))
+        continue;
+      fields >> action.replacement;
+      actions.push_back(action);
+    }
+    return true;
+  }
+
+  std::string applyActions(const std::string & input, const Actions & actions,
+                           const std::vector<bool> & removed)
+  {
+    std::string output(input);
+    for (size_t i = 0; i < actions.size(); ++i)
+    {
+      if (!removed[i])
+        continue;
+
+      const Action & action = actions[i];
+      std::string text(action.replacement);
+      if (action.end > action.begin + text.size())
+        text.append(action.end - action.begin - text.size(), ' ');
+      if (action.begin + text.size() > output.size())
+        output.resize(action.begin + text.size(), ' ');
+      output.replace(action.begin, text.size(), text);
+    }
+    return output;
+  }
+
+  // Configurations are indices into the actions, in order.
+  class PhaseTwoOracle
+  {
+  public:
+    PhaseTwoOracle(const std::string & inputText, const Actions & nodeActions,
+                   const std::string & inputFileName,
+                   const std::string & testCommand)
+      :input(inputText),
+       actions(nodeActions),
+       fileName(inputFileName),
+       command(testCommand)
+    {
+    }
+
+    std::string render(const std::vector<size_t> & c) const
+    {
+      std::vector<bool> removed(actions.size(), true);
+      for (size_t i = 0; i < c.size(); ++i)
+      {
+        removed[c[i]] = false;
+      }
+      return applyActions(input, actions, removed);
+    }
+
+    Outcome operator()(const std::vector<size_t> & c, size_t slot)
+    {
+      std::string candidate = slotFileName(fileName, slot);
+      if (!writeFile(candidate, render(c)))
+        return UNRESOLVED;
+      return runCompiler(command, candidate);
+    }
+
+  private:
+    const std::string & input;
+    const Actions & actions;
+    std::string fileName;
+    std::string command;
+  };
+
+  struct ActionSize
+  {
+    ActionSize(const Actions * nodeActions = NULL)
+      :actions(nodeActions)
+    {
+    }
+
+    size_t operator()(size_t i) const
+    {
+      return (*actions)[i].end - (*actions)[i].begin;
+    }
+
+    const Actions * actions;
+  };
+
+  template <class Split, class Executor>
+  int reduce(PhaseTwoOracle & oracle, const Actions & actions,
+             const std::string & outputFileName, double deadline,
+             const Split & split, const Executor & executor)
+  {
+    std::vector<size_t> c;
+    for (size_t i = 0; i < actions.size(); ++i)
+    {
+      c.push_back(i);
+    }
+
+    DDMin<size_t, PhaseTwoOracle, Split, OutcomeCache<size_t>, Executor>
+      dd(oracle, split, OutcomeCache<size_t>(), executor);
+    dd.stopAt(deadline);
+    std::vector<size_t> minimal = dd.minimize(c);
+
+    if (!writeFile(outputFileName, oracle.render(minimal)))
+    {
+      std::cerr << "cannot write " << outputFileName << "\n";
+      return 1;
+    }
+
+    std::vector<bool> kept(actions.size(), false);
+    for (size_t i = 0; i < minimal.size(); ++i)
+    {
+      kept[minimal[i]] = true;
+    }
+    for (size_t i = 0; i < actions.size(); ++i)
+    {
+      if (!kept[i])
+        std::cout << "REMOVED " << actions[i].symbol << "\n";
+    }
+    std::cout << "MINIMAL CASE: " << minimal.size() << "\n";
+    printStatistics(std::cout, dd.statistics());
+    return 0;
+  }
+
+  template <class Split>
+  int reduceWith(PhaseTwoOracle & oracle, const Actions & actions,
+                 const std::string & outputFileName, double deadline,
+                 const Split & split, size_t jobs)
+  {
+    if (jobs > 1)
+      return reduce(oracle, actions, outputFileName, deadline, split,
+                    ParallelExecutor(jobs));
+    return reduce(oracle, actions, outputFileName, deadline, split,
+                  SerialExecutor());
+  }
+
+  void usage()
+  {
+    std::cerr << "usage: DDPhase2 [-j JOBS] [-t SECONDS] "
+              << "[-c DEPENDENCIES | -w] DELTAS INPUT OUTPUT COMMAND...\n"
+              << "  -j JOBS          test JOBS candidates at a time\n"
+              << "  -t SECONDS       stop after SECONDS with the smallest "
+              << "failing input so far\n"
+              << "  -c DEPENDENCIES  split into dependency-closed subsets; "
+              << "one 'used user' pair per line\n"
+              << "  -w               split into subsets of about the same "
+              << "size in bytes\n";
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  size_t jobs = 1;
+  double deadline = 0;
+  std::string dependencyFileName;
+  bool weighted = false;
+
+  // stop at FILE: the options after it are the test command's
+  int option;
+  while ((option = getopt(argc, argv, "+j:t:c:w")) != -1)
+  {
+    switch (option)
+    {
+      case 'j':
+        jobs = atoi(optarg);
+        break;
+      case 't':
+        deadline = now() + atof(optarg);
+        break;
+      case 'c':
+        dependencyFileName = optarg;
+        break;
+      case 'w':
+        weighted = true;
+        break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+  if (argc - optind < 4)
+  {
+    usage();
+    return 2;
+  }
+
+  std::string deltasFileName(argv[optind]);
+  std::string inputFileName(argv[optind + 1]);
+  std::string outputFileName(argv[optind + 2]);
+  std::string command;
+  for (int i = optind + 3; i < argc; ++i)
+  {
+    command += (command.empty() ? "" : " ") + std::string(argv[i]);
+  }
+
+  Actions actions;
+  std::string input;
+  if (!readActions(deltasFileName, actions) || !readFile(inputFileName, input))
+  {
+    std::cerr << "cannot read " << deltasFileName << " or "
+              << inputFileName << "\n";
+    return 1;
+  }
+
+  PhaseTwoOracle oracle(input, actions, inputFileName, command);
+
+  if (!dependencyFileName.empty())
+  {
+    std::map<std::string, size_t> indexOf;
+    for (size_t i = 0; i < actions.size(); ++i)
+    {
+      indexOf[actions[i].symbol] = i;
+    }
+
+    std::string contents;
+    if (!readFile(dependencyFileName, contents))
+    {
+      std::cerr << "cannot read " << dependencyFileName << "\n";
+      return 1;
+    }
+    DependencyClosedSplit<size_t> split;
+    std::istringstream lines(contents);
+    std::string used, user;
+    while (lines >> used >> user)
+    {
+      if (indexOf.count(used) && indexOf.count(user))
+        split.addDependency(indexOf[used], indexOf[user]);
+    }
+    return reduceWith(oracle, actions, outputFileName, deadline, split,
+                      jobs);
+  }
+
+  if (weighted)
+    return reduceWith(oracle, actions, outputFileName, deadline,
+                      SizeWeightedSplit<ActionSize>(ActionSize(&actions)),
+                      jobs);
+
+  return reduceWith(oracle, actions, outputFileName, deadline, UniformSplit(),
+                    jobs);
+}
@@ -0,0 +1,404 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/FileSystemOptions.h>
+#include <clang/Basic/LangOptions.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/Lexer.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "CompilerTest.hpp"
+#include "DDMin.hpp"
+
+// Token-level reduction, the last stage after the node-level one: the file
+// is lexed with clang's raw lexer and ddmin runs over units of tokens, a
+// level at a time. A unit is a single token, a preprocessor directive line,
+// or a balanced (...), [...] or {...} group. A group is first tried as a
+// whole; its contents become the units of the next level only if it stays.
+// Candidates are rendered straight from the token array, so a test never
+// has to lex anything.
+
+using namespace clang;
+using namespace ddmin;
+
+namespace
+{
+  struct TokenText
+  {
+    std::string text;
+    bool startOfLine;
+    bool leadingSpace;
+    bool startsDirective;
+  };
+
+  typedef std::vector<TokenText> Tokens;
+
+  // Tokens [first, last]; children are the units inside a group.
+  struct Unit
+  {
+    size_t first;
+    size_t last;
+    std::vector<size_t> children;
+  };
+
+  typedef std::vector<Unit> Units;
+
+  bool isCPlusPlusFile(const std::string & fileName)
+  {
+    std::string extension = fileName.substr(fileName.rfind('.') + 1);
+    return extension == "cpp" || extension == "cc" || extension == "cxx" ||
+      extension == "C" || extension == "ii";
+  }
+
+  void lex(const std::string & fileName, const std::string & contents,
+           Tokens & tokens, std::vector<tok::TokenKind> & kinds)
+  {
+    llvm::IntrusiveRefCntPtr<DiagnosticIDs> diagIDs(new DiagnosticIDs());
+    Diagnostic diags(diagIDs, new IgnoringDiagClient());
+    FileSystemOptions fileSystemOptions;
+    FileManager fileManager(fileSystemOptions);
+    SourceManager SM(diags, fileManager);
+
+    LangOptions langOptions;
+    if (isCPlusPlusFile(fileName))
+    {
+      langOptions.CPlusPlus = 1;
+    }
+    else
+    {
+      langOptions.C99 = 1;
+    }
+
+    FileID mainFile = SM.createMainFileIDForMemBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(contents, fileName));
+    Lexer lexer(mainFile, SM.getBuffer(mainFile), SM, langOptions);
+
+    Token token;
+    for (lexer.LexFromRawLexer(token);
+         token.isNot(tok::eof);
+         lexer.LexFromRawLexer(token))
+    {
+      TokenText text;
+      text.text = contents.substr(SM.getFileOffset(token.getLocation()),
+                                  token.getLength());
+      text.startOfLine = token.isAtStartOfLine();
+      text.leadingSpace = token.hasLeadingSpace();
+      text.startsDirective = token.is(tok::hash) && token.isAtStartOfLine();
+      tokens.push_back(text);
+      kinds.push_back(token.getKind());
+    }
+  }
+
+  tok::TokenKind closing(tok::TokenKind kind)
+  {
+    switch (kind)
+    {
+      case tok::l_paren:
+        return tok::r_paren;
+      case tok::l_square:
+        return tok::r_square;
+      case tok::l_brace:
+        return tok::r_brace;
+      default:
+        return tok::unknown;
+    }
+  }
+
+  // Units of tokens [begin, end), appended to UNITS; returns their indices.
+  // Unbalanced brackets are plain tokens.
+  std::vector<size_t> buildUnits(const Tokens & tokens,
+                                 const std::vector<tok::TokenKind> & kinds,
+                                 size_t begin, size_t end, Units & units)
+  {
+    std::vector<size_t> level;
+    size_t i = begin;
+    while (i < end)
+    {
+      Unit unit;
+      unit.first = i;
+      unit.last = i;
+
+      if (kinds[i] == tok::hash && tokens[i].startOfLine)
+      {
+        // the rest of the directive's line
+        while (unit.last + 1 < end && !tokens[unit.last + 1].startOfLine)
+        {
+          ++unit.last;
+        }
+      }
+      else if (closing(kinds[i]) != tok::unknown)
+      {
+        std::vector<tok::TokenKind> open(1, closing(kinds[i]));
+        size_t j = i + 1;
+        for (; j < end && !open.empty(); ++j)
+        {
+          if (closing(kinds[j]) != tok::unknown)
+          {
+            open.push_back(closing(kinds[j]));
+          }
+          else if (kinds[j] == open.back())
+          {
+            open.pop_back();
+          }
+        }
+        if (open.empty())
+        {
+          unit.last = j - 1;
+          // the group goes in before its contents, which need its index
+          units.push_back(unit);
+          size_t index = units.size() - 1;
+          std::vector<size_t> children =
+            buildUnits(tokens, kinds, i + 1, unit.last, units);
+          units[index].children = children;
+          level.push_back(index);
+          i = unit.last + 1;
+          continue;
+        }
+      }
+
+      units.push_back(unit);
+      level.push_back(units.size() - 1);
+      i = unit.last + 1;
+    }
+    return level;
+  }
+
+  // A directive ends at the end of its line, so the first token kept after
+  // it goes on a new line even if the token that started that line is gone.
+  std::string render(const Tokens & tokens, const std::vector<bool> & removed)
+  {
+    std::string text;
+    bool previousKept = true;
+    bool first = true;
+    bool inDirective = false;
+    bool newLine = false;
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+      newLine = newLine || tokens[i].startOfLine;
+      if (removed[i])
+      {
+        previousKept = false;
+        continue;
+      }
+      if (!first)
+      {
+        if (tokens[i].startOfLine || (inDirective && newLine))
+          text += "\n";
+        else if (tokens[i].leadingSpace || !previousKept)
+          text += " ";
+      }
+      if (newLine)
+        inDirective = tokens[i].startsDirective;
+      text += tokens[i].text;
+      first = false;
+      previousKept = true;
+      newLine = false;
+    }
+    return text + "\n";
+  }
+
+  // Tests one level: a configuration is the units of LEVEL that stay; the
+  // tokens removed on earlier levels stay removed.
+  class TokenOracle
+  {
+  public:
+    TokenOracle(const Tokens & lexedTokens, const Units & allUnits,
+                const std::vector<size_t> & levelUnits,
+                const std::vector<bool> & removedTokens,
+                const std::string & inputFileName,
+                const std::string & testCommand)
+      :tokens(lexedTokens),
+       units(allUnits),
+       level(levelUnits),
+       removed(removedTokens),
+       fileName(inputFileName),
+       command(testCommand)
+    {
+    }
+
+    std::vector<bool> removedBy(const std::vector<size_t> & c) const
+    {
+      std::vector<bool> result(removed);
+      std::vector<bool> stays(level.size(), false);
+      for (size_t i = 0; i < c.size(); ++i)
+      {
+        stays[c[i]] = true;
+      }
+      for (size_t i = 0; i < level.size(); ++i)
+      {
+        if (stays[i])
+          continue;
+        const Unit & unit = units[level[i]];
+        for (size_t t = unit.first; t <= unit.last; ++t)
+        {
+          result[t] = true;
+        }
+      }
+      return result;
+    }
+
+    Outcome operator()(const std::vector<size_t> & c, size_t slot)
+    {
+      std::string candidate = slotFileName(fileName, slot);
+      if (!writeFile(candidate, render(tokens, removedBy(c))))
+        return UNRESOLVED;
+      return runCompiler(command, candidate);
+    }
+
+  private:
+    const Tokens & tokens;
+    const Units & units;
+    const std::vector<size_t> & level;
+    const std::vector<bool> & removed;
+    std::string fileName;
+    std::string command;
+  };
+
+  template <class Executor>
+  int reduce(const Tokens & tokens, const Units & units,
+             const std::vector<size_t> & topLevel,
+             const std::string & inputFileName,
+             const std::string & outputFileName,
+             const std::string & command, double deadline,
+             const Executor & executor)
+  {
+    std::vector<bool> removed(tokens.size(), false);
+
+    // comments are gone from the start, so make sure it still fails
+    std::string candidate = slotFileName(inputFileName, 0);
+    if (!writeFile(candidate, render(tokens, removed)) ||
+        runCompiler(command, candidate) != FAIL)
+    {
+      std::cerr << "the lexed input does not fail\n";
+      return 1;
+    }
+
+    Statistics total;
+    std::vector<size_t> level(topLevel);
+    size_t depth = 0;
+    while (!level.empty() && !total.timedOut)
+    {
+      TokenOracle oracle(tokens, units, level, removed, inputFileName,
+                         command);
+      DDMin<size_t, TokenOracle, UniformSplit, OutcomeCache<size_t>,
+            Executor> dd(oracle, UniformSplit(), OutcomeCache<size_t>(),
+                         executor);
+      dd.stopAt(deadline);
+
+      std::vector<size_t> c;
+      for (size_t i = 0; i < level.size(); ++i)
+      {
+        c.push_back(i);
+      }
+      std::vector<size_t> kept = dd.minimize(c);
+      removed = oracle.removedBy(kept);
+
+      const Statistics & stats = dd.statistics();
+      std::cout << "LEVEL " << depth << ": " << kept.size() << " of "
+                << level.size() << " units in " << stats.tests
+                << " tests\n";
+      total.rounds += stats.rounds;
+      total.cacheHits += stats.cacheHits;
+      total.unresolved += stats.unresolved;
+      total.tests += stats.tests;
+      total.timedOut = stats.timedOut;
+
+      std::vector<size_t> next;
+      for (size_t i = 0; i < kept.size(); ++i)
+      {
+        const Unit & unit = units[level[kept[i]]];
+        next.insert(next.end(), unit.children.begin(), unit.children.end());
+      }
+      level.swap(next);
+      ++depth;
+    }
+
+    size_t left = 0;
+    for (size_t i = 0; i < removed.size(); ++i)
+    {
+      left += removed[i] ? 0 : 1;
+    }
+    if (!writeFile(outputFileName, render(tokens, removed)))
+    {
+      std::cerr << "cannot write " << outputFileName << "\n";
+      return 1;
+    }
+    std::cout << "TOKENS: " << left << " of " << tokens.size() << "\n";
+    printStatistics(std::cout, total);
+    return 0;
+  }
+
+  void usage()
+  {
+    std::cerr << "usage: TokenDD [-j JOBS] [-t SECONDS] [-o OUTPUT] "
+              << "FILE COMMAND...\n";
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  size_t jobs = 1;
+  double deadline = 0;
+  std::string outputFileName;
+
+  // stop at FILE: the options after it are the test command's
+  int option;
+  while ((option = getopt(argc, argv, "+j:t:o:")) != -1)
+  {
+    switch (option)
+    {
+      case 'j':
+        jobs = atoi(optarg);
+        break;
+      case 't':
+        deadline = now() + atof(optarg);
+        break;
+      case 'o':
+        outputFileName = optarg;
+        break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+  if (argc - optind < 2)
+  {
+    usage();
+    return 2;
+  }
+
+  std::string inputFileName(argv[optind]);
+  std::string command;
+  for (int i = optind + 1; i < argc; ++i)
+  {
+    command += (command.empty() ? "" : " ") + std::string(argv[i]);
+  }
+  if (outputFileName.empty())
+    outputFileName = inputFileName + "_tokens";
+
+  std::string contents;
+  if (!readFile(inputFileName, contents))
+  {
+    std::cerr << "cannot read " << inputFileName << "\n";
+    return 1;
+  }
+
+  Tokens tokens;
+  std::vector<tok::TokenKind> kinds;
+  lex(inputFileName, contents, tokens, kinds);
+
+  Units units;
+  std::vector<size_t> topLevel = buildUnits(tokens, kinds, 0, tokens.size(),
+                                            units);
+
+  if (jobs > 1)
+    return reduce(tokens, units, topLevel, inputFileName, outputFileName,
+                  command, deadline, ParallelExecutor(jobs));
+  return reduce(tokens, units, topLevel, inputFileName, outputFileName,
+                command, deadline, SerialExecutor());
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Pick the cheapest variant of the test command that still crashes the
+same way.
+
+Many crashes happen in the front end or the middle end and show up without
+assembling the output, without optimizing or without even generating code.
+The variants tried stop the compiler earlier (-S, -fsyntax-only) and lower
+the optimization level. Each one is timed on the original input and kept if
+it gives the same crash signature as the original command; the fastest one
+wins.
+"""
+
+import time
+
+from outcome import runCompilerWithOutput, crashSignature
+
+# from the most work to the least; only those after the original are tried
+stageOptions = ['-c', '-S', '-fsyntax-only']
+optimizationLevels = ['-O3', '-O2', '-O1', '-O0']
+
+
+def cheaperCommands(commandName):
+    """Variants of COMMANDNAME that stop at an earlier stage or optimize
+    less, not including COMMANDNAME itself.
+    """
+    words = commandName.split()
+    stage = None
+    level = None
+    base = []
+    for word in words:
+        if word in stageOptions:
+            stage = word
+        elif word.startswith('-O'):
+            level = word
+        else:
+            base.append(word)
+
+    stages = stageOptions
+    if stage in stageOptions:
+        stages = stageOptions[stageOptions.index(stage):]
+    if level is None:
+        # no -O optimizes like -O0 already; a higher level would cost more
+        levels = [None, '-O0']
+    elif level in optimizationLevels:
+        levels = optimizationLevels[optimizationLevels.index(level):]
+    else:
+        levels = [level]
+
+    variants = []
+    for s in stages:
+        for l in levels:
+            options = [s]
+            if l is not None:
+                options.append(l)
+            variant = ' '.join(base[:1] + options + base[1:])
+            if variant != commandName and variant not in variants:
+                variants.append(variant)
+    return variants
+
+
+def timeCommand(commandName, fileName, repeat):
+    """Best wall time of REPEAT runs, and the crash signature."""
+    best = None
+    signature = None
+    for i in xrange(repeat):
+        start = time.time()
+        status, output = runCompilerWithOutput(commandName, fileName)
+        seconds = time.time() - start
+        signature = crashSignature(output)
+        if best is None or seconds < best:
+            best = seconds
+    return best, signature
+
+
+def calibrate(commandName, fileName, repeat=2):
+    """Returns (command, signature, [(variant, seconds, signature)])."""
+    seconds, signature = timeCommand(commandName, fileName, repeat)
+    measurements = [(commandName, seconds, signature)]
+    best, bestSeconds = commandName, seconds
+    if signature is None:
+        return best, signature, measurements
+
+    for variant in cheaperCommands(commandName):
+        variantSeconds, variantSignature = timeCommand(variant, fileName,
+                                                       repeat)
+        measurements.append((variant, variantSeconds, variantSignature))
+        if variantSignature == signature and variantSeconds < bestSeconds:
+            best, bestSeconds = variant, variantSeconds
+    return best, signature, measurements
+
+
+def recheck(commandName, fileName, signature):
+    """Returns (whether COMMANDNAME still crashes with SIGNATURE on
+    FILENAME, the signature it crashed with).
+    """
+    status, output = runCompilerWithOutput(commandName, fileName)
+    actual = crashSignature(output)
+    return actual == signature, actual
@@ -11,15 +11,30 @@ import os.path
 from os import symlink
 from shutil import copy, move
 from subprocess import call
+import subprocess
 from pyswip import Prolog
 
-import commands
 import math
+import multiprocessing
+import random
+import socket
 import timeit
 import time
 
 from split import *
 from listsets import *
+from ordering import AdaptiveOrdering, loadFeatures
+from reachability import ReachabilityIndex
+from labelstore import *
+from journal import Journal, JournalMismatch
+import journal
+from testtrace import TraceRecorder, TraceReplayer
+from outcome import runCompiler, runCompilerWithOutput, crashFunction
+from outcome import resourceLimits, TestUsage, runCompilerWithUsage
+from metrics import Metrics, MetricsWriter, serveMetrics
+from oracle import PersistentOracle
+from calibrate import calibrate, recheck
+from factcache import FactCache
 
 prolog = Prolog()
 ################################################################################
@@ -33,6 +48,100 @@ commandName = "/s/gcc-3.4.4/bin/gcc -c -O3"
 
 numberOfUnresolvedTests = 0
 numberOfTotalTests = 0
+
+# driver-side copy of the labels, rebuilt by invokeSDD
+labelStore = None
+# symbol -> bytes its removal takes out, for the adaptive ordering of a timed
+# run; refreshed as nodes are deleted or marked essential
+removalSizes = None
+
+# on-disk journal of committed labels, see journal.py
+runJournal = None
+
+# record the tests of a run to a trace file, or replay one instead of calling
+# the compiler, see testtrace.py
+traceRecorder = None
+traceReplayer = None
+
+# before phase 1, remove everything the function the compiler crashed in
+# doesn't need in as few tests as possible
+crashLocality = False
+# before phase 1, sweep out all dead declarations, then all function bodies
+# but the crashing one, each in as few tests as possible
+sweeps = False
+
+# run the compiler under these rlimits and record the peak RSS and CPU time
+# of every run, see outcome.py
+testLimits = None
+testUsage = None
+
+# facts of earlier runs on the same input, see factcache.py
+factCache = None
+
+# before generating constraints, ddmin over the #include lines and line
+# marker regions of the input (see IncludeRegions.cpp)
+includeRegionsFileName = 'regions.txt'
+
+# anytime mode: stop at the deadline and keep BESTFILENAME up to date with the
+# smallest failing file found so far
+timeBudget = None
+deadline = None
+bestFileName = None
+totalTestSeconds = 0.0
+
+# run the tests through a reduction daemon (sddd.py) instead of calling the
+# compiler directly. the connection belongs to the process that opened it, so
+# forked component workers open their own.
+testServerPath = None
+jobId = None
+testServerConnection = None
+
+# ask a long-running oracle process instead of running the test command for
+# every test, see oracle.py. like the daemon connection, an oracle belongs to
+# the process that started it.
+oracleCommand = None
+oracleOptions = {}
+persistentOracle = None
+
+# live metrics of the run, see metrics.py
+metrics = None
+currentPhase = None
+phaseStarted = None
+runStarted = time.time()
+
+# batched phase 1: test the removal of several independent nodes at once and
+# bisect on anything but FAIL. the batch size adapts to the success rate of
+# the last few batches.
+batchDeletion = False
+maxBatchCandidateScan = 256
+batchHistoryLength = 4
+
+# levels of the hierarchical schedule, see reductionLevel/2
+reductionLevels = [0, 1, 2]
+
+# score the deterministic heuristics from a bitset reachability index built
+# once per run instead of walking the dependency graph in prolog
+bitsetScoring = False
+bitsetHeuristics = {'TOP': 'TOP', 'BOTTOM': 'BOTTOM', 'AVERAGE': 'AVERAGE',
+                    'LEVEL': 'TOP'}
+
+# reduce the independent components of the dependency graph in separate
+# worker processes before the serial loop
+parallelComponents = False
+numberOfJobs = multiprocessing.cpu_count()
+# what forked workers need to know about the run, set before forking
+componentContext = None
+
+# split the phase 2 nodes into subsets that are closed under the dependency
+# relation instead of plain slices of the list
+closedPartition = False
+
+# path of src/ddmin/DDPhase2, which runs phase 2 on its own given the deletion
+# action of every node
+nativePhase2 = None
+
+# path of src/ddmin/TokenDD, which runs ddmin over the tokens of the result
+tokenStage = None
 ################################################################################
 def getValueFromAtom(a):
     if isinstance(a, str):
@@ -67,29 +176,153 @@ def isVariableNone(v):
     return v == None or v == '' or v == '[]' or v == []
 
 
-def runTest(commandName, fileName, logTest=True):
-    # Invoke GCC
-    (status, output) = commands.getstatusoutput(
-        "%s %s 2>&1" % (commandName, fileName))
+def serverOutcome(commandName, fileName):
+    global testServerConnection
+    if testServerConnection is None or testServerConnection[0] != os.getpid():
+        connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        connection.connect(testServerPath)
+        testServerConnection = (os.getpid(), connection.makefile('r+', 0))
+    stream = testServerConnection[1]
+    stream.write("TEST %s %s %s\n" % (jobId, os.path.abspath(fileName),
+                                      commandName))
+    stream.flush()
+    return stream.readline().strip()
+
+
+def oracleOutcome(fileName):
+    global persistentOracle
+    if persistentOracle is None or persistentOracle[0] != os.getpid():
+        persistentOracle = (os.getpid(),
+                            PersistentOracle(oracleCommand, **oracleOptions))
+    return persistentOracle[1].test(fileName)
+
+
+def compilerOutcome(commandName, fileName):
+    if oracleCommand is not None:
+        return oracleOutcome(fileName)
+    if testServerPath is not None:
+        return serverOutcome(commandName, fileName)
+    if testLimits is not None:
+        result, rss, cpuSeconds = runCompilerWithUsage(commandName, fileName,
+                                                       testLimits)
+        testUsage.record(result, rss, cpuSeconds)
+        return result
+    return runCompiler(commandName, fileName)
 
-    # print output
-    # print "Exit code", status
 
-    # Determine outcome
+def runTest(commandName, fileName, logTest=True, candidates=None):
+    """CANDIDATES are the nodes removed from FILENAME for this test; they only
+    matter to traces.
+    """
+    testStart = time.time()
+    if traceReplayer is not None:
+        result = traceReplayer.outcome(candidates, fileName)
+    else:
+        result = compilerOutcome(commandName, fileName)
+    if traceRecorder is not None:
+        traceRecorder.record(candidates, fileName, result)
+
     global numberOfUnresolvedTests
     global numberOfTotalTests
+    global totalTestSeconds
     numberOfTotalTests += 1
-    if status == 0 and output.find("warning") <0:
-        return 'PASS'
-    elif output.find("warning") >=0:
-        if logTest:
-            numberOfUnresolvedTests += 1
-        return 'UNRESOLVED'
-    elif output.find("internal compiler error") >= 0:
-        return 'FAIL'
-    if logTest:
+    testSeconds = time.time() - testStart
+    totalTestSeconds += testSeconds
+    if metrics is not None:
+        metrics.increment('tests_total', (('outcome', result),))
+        metrics.observe('test_duration_seconds', testSeconds)
+    if result == 'UNRESOLVED' and logTest:
         numberOfUnresolvedTests += 1
-    return 'UNRESOLVED'
+    return result
+
+
+def nonBlankBytes(fileName):
+    """Size of FILENAME leaving out whitespace; deletions are padded with
+    spaces, so the plain file size only drops once the file is cleaned up.
+    """
+    with open(fileName) as f:
+        return len(''.join(f.read().split()))
+
+
+def startMetrics(fileName, port):
+    global metrics
+    metrics = Metrics()
+    metrics.describe('tests_total', 'counter', 'Compiler runs by outcome.')
+    metrics.describe('test_duration_seconds', 'histogram',
+                     'Wall time of one compiler run.')
+    metrics.describe('tests_per_second', 'gauge',
+                     'Compiler runs per second since the start of the run.')
+    metrics.describe('current_file_bytes', 'gauge',
+                     'Non-blank bytes of the current minimal file.')
+    metrics.describe('removable_nodes', 'gauge',
+                     'Nodes that are still candidates for removal.')
+    metrics.describe('phase', 'gauge', 'The phase the reduction is in.')
+    metrics.describe('phase_seconds_total', 'counter',
+                     'Time spent in each finished phase.')
+    metrics.compute('tests_per_second', lambda: numberOfTotalTests /
+                    max(time.time() - runStarted, 1e-6))
+    metrics.compute('current_file_bytes',
+                    lambda: nonBlankBytes(currentMinimalFileName))
+    metrics.compute('removable_nodes', lambda: labelStore.countRemovableWUD())
+
+    writer = None
+    if fileName is not None:
+        writer = MetricsWriter(metrics, fileName)
+        writer.start()
+    if port is not None:
+        serveMetrics(metrics, port)
+    return writer
+
+
+def enterPhase(phase):
+    global currentPhase
+    global phaseStarted
+    now = time.time()
+    if metrics is not None:
+        if currentPhase is not None:
+            metrics.increment('phase_seconds_total',
+                              (('phase', currentPhase),), now - phaseStarted)
+            metrics.set('phase', 0, (('phase', currentPhase),))
+        metrics.set('phase', 1, (('phase', phase),))
+    currentPhase = phase
+    phaseStarted = now
+
+
+def meanTestTime():
+    if numberOfTotalTests == 0:
+        return 0.0
+    return totalTestSeconds / numberOfTotalTests
+
+
+def outOfTime(margin=0.0):
+    """True once there is less than MARGIN seconds left of the time budget."""
+    return deadline is not None and time.time() + margin >= deadline
+
+
+def stripBlankLines(inputFileName, outputFileName):
+    with open(inputFileName) as ifile:
+        with open(outputFileName, 'w') as ofile:
+            for line in ifile:
+                lineStrip = line.strip()
+                if lineStrip == '' or lineStrip == ';':
+                    continue
+                ofile.write(line)
+
+
+def saveBest():
+    """Replace BESTFILENAME with the current minimal file in one rename, so
+    whoever is waiting on it never sees a half-written file.
+    """
+    if bestFileName is None:
+        return
+    temporaryFileName = "%s.tmp" % bestFileName
+    stripBlankLines(currentMinimalFileName, temporaryFileName)
+    os.rename(temporaryFileName, bestFileName)
+
+
+def acceptTentative():
+    copy(tentativeMinimalFileName, currentMinimalFileName)
+    saveBest()
 
 
 def applyChanges(fileName, actionList):
@@ -100,19 +333,84 @@ def applyChanges(fileName, actionList):
             fileHandle.write(replacement)
 
 
+def getSymbolList(QR, var='L'):
+    if QR is None or isVariableNone(QR[var]):
+        return []
+    return map(getValueFromAtom, QR[var])
+
+
+def recordLabels(op, symbols):
+    if runJournal is not None:
+        runJournal.append(op, symbols)
+
+
+def refreshRemovalSizes(symbols):
+    """SYMBOLS left the removal lists of the nodes they depend on."""
+    if removalSizes is None or not symbols:
+        return
+    QR = getQueryResult("transitiveRemovalSizesAbove([%s], L)" %
+                        ', '.join(symbols))
+    if QR is None or isVariableNone(QR['L']):
+        return
+    for t in QR['L']:
+        removalSizes[getValueFromAtom(t.args[0])] = t.args[1]
+
+
 def markNodes(result, node):
-    command = None
     if result == 'FAIL':
         # print "NONESSENTIAL:", node
-        command = "permanentlyDelete(%s)" % node
+        QR = getQueryResult("permanentlyDelete(%s, L)" % node)
+        labelStore.mark(PERMANENTLY_DELETED, getSymbolList(QR))
+        refreshRemovalSizes(getSymbolList(QR))
+        recordLabels(journal.DELETE, getSymbolList(QR))
     elif result == 'PASS':
         # print "ESSENTIAL:", node
-        command = "recursivelyMarkEssential(%s)" % node
+        QR = getQueryResult("recursivelyMarkEssential(%s, L)" % node)
+        labelStore.mark(ESSENTIAL, getSymbolList(QR))
+        refreshRemovalSizes(getSymbolList(QR))
+        recordLabels(journal.ESSENTIAL, getSymbolList(QR))
     else:
         # print "UNRESOLVED:", node
         # import ipdb; ipdb.set_trace()
-        command = "assertHasUntrackedDependency(%s)" % node
-    return getQueryResult(command)
+        QR = getQueryResult("assertHasUntrackedDependency(%s)" % node)
+        labelStore.mark(UNTRACKED, [node])
+        recordLabels(journal.UNTRACKED, [node])
+    return QR
+
+
+def commitLabels(op, symbols, record=True):
+    """Label a whole list of nodes the driver has decided on, as opposed to
+    markNodes, which lets the label predicates work out the list.
+    """
+    symbolsStr = "[%s]" % ', '.join(symbols)
+    if op == journal.DELETE:
+        getQueryResult("permanentlyDeleteList(%s)" % symbolsStr)
+        labelStore.mark(PERMANENTLY_DELETED, symbols)
+        refreshRemovalSizes(symbols)
+    elif op == journal.ESSENTIAL:
+        getQueryResult("markEssentialList(%s)" % symbolsStr)
+        labelStore.mark(ESSENTIAL, symbols)
+        refreshRemovalSizes(symbols)
+    elif op == journal.UNTRACKED:
+        getQueryResult("markUntrackedList(%s)" % symbolsStr)
+        labelStore.mark(UNTRACKED, symbols)
+    if record:
+        recordLabels(op, symbols)
+
+
+def replayJournal():
+    """Rebuild the labels and the current minimal file from the journal
+    without running any test.
+    """
+    for op, symbols in runJournal.records:
+        if op == journal.REGIONS:
+            # reduceIncludeRegions has already applied these
+            continue
+        if op == journal.DELETE:
+            removeNodeList(currentMinimalFileName, symbols)
+        commitLabels(op, symbols, False)
+    saveBest()
+    print "RESUMED: %d JOURNAL RECORDS" % len(runJournal.records)
 
 # def markNodeList(result, nodeList):
 #     for node in nodeList:
@@ -141,6 +439,7 @@ def removeNodeTransitively(fileName, symbolToRemove):
         currentDeletionSet = map(getValueFromAtom, QR['L1'])
         applyChanges(fileName, QR['L2'])
         getQueryResult("delete(%s)" % symbolToRemove)
+        labelStore.mark(DELETED, currentDeletionSet)
     return currentDeletionSet
 
 def removeNodeList(fileName, symbols):
@@ -150,6 +449,131 @@ def removeNodeList(fileName, symbols):
                         symbolsStr)
     applyChanges(fileName, QR['L'])
 
+def removeNodeBatch(fileName, symbols):
+    symbolsStr = "[%s]" % ', '.join(symbols)
+    QR = getQueryResult("recursivelyComputeDeletionActionForList(%s, L1, L2)" %
+                        symbolsStr)
+    if QR is None or isVariableNone(QR['L1']):
+        return None
+    applyChanges(fileName, QR['L2'])
+    return map(getValueFromAtom, QR['L1'])
+
+def removePrecomputedBatch(fileName, symbols, precomputed):
+    """Same as removeNodeBatch with the removal lists and actions of
+    topCandidates, applied in the order of the merged removal list."""
+    actions = {}
+    for symbol in symbols:
+        removalList, actionList = precomputed[symbol]
+        actions.update(zip(removalList, actionList))
+    applyChanges(fileName, [actions[symbol] for symbol in sorted(actions)])
+
+
+def topCandidates(symbols, k, comparator=None):
+    """The K best of SYMBOLS by COMPARATOR (see topScoringAmong), or by the
+    score of topScoringRemovableWUD without one, best first, as (symbol,
+    removal list, deletion actions), from one query.
+    """
+    if comparator is None:
+        query = "topKCandidates([%s], %d, C)" % (', '.join(symbols), k)
+    else:
+        if comparator == 'random':
+            symbols = list(symbols)
+            random.shuffle(symbols)
+        query = "topKCandidates(%s, [%s], %d, C)" % (comparator,
+                                                     ', '.join(symbols), k)
+    QR = getQueryResult(query)
+    if QR is None or isVariableNone(QR['C']):
+        return []
+    return [(getValueFromAtom(c.args[0]), map(getValueFromAtom, c.args[1]),
+             c.args[2]) for c in QR['C']]
+
+
+def selectIndependentBatch(candidateGroup, batchSize, comparator=None):
+    """Pick up to BATCHSIZE removable nodes whose transitive removal lists
+    don't overlap, so that each of them can be kept or dropped on its own.
+    The best scoring nodes by COMPARATOR are tried first. Returns the batch
+    and what testBatch needs to remove it without asking the solver again.
+    """
+    batch = []
+    precomputed = {}
+    taken = set()
+    candidates = topCandidates(labelStore.allRemovableWUD(candidateGroup),
+                               maxBatchCandidateScan, comparator)
+    for symbol, removalList, actionList in candidates:
+        if symbol in taken:
+            continue
+        removalSet = set(removalList)
+        if removalSet & taken:
+            continue
+        taken |= removalSet
+        batch.append(symbol)
+        precomputed[symbol] = (removalList, actionList)
+        if len(batch) == batchSize:
+            break
+    return batch, precomputed
+
+
+def testBatch(batch, precomputed=None):
+    """Try removing every node in BATCH in one test. On anything but FAIL the
+    batch is bisected until single nodes are left, which get labelled the same
+    way the one-at-a-time loop labels them. Returns the number of nodes that
+    were permanently deleted.
+
+    PRECOMPUTED maps the nodes of a batch from selectIndependentBatch to their
+    removal lists and actions. Those stay valid while the batch is bisected:
+    with disjoint removal lists, labelling one node never touches the list of
+    another.
+    """
+    batch = [symbol for symbol in batch if labelStore.isRemovable(symbol)]
+    if len(batch) == 0 or outOfTime():
+        return 0
+
+    copy(currentMinimalFileName, tentativeMinimalFileName)
+    if precomputed is not None:
+        removePrecomputedBatch(tentativeMinimalFileName, batch, precomputed)
+    elif removeNodeBatch(tentativeMinimalFileName, batch) is None:
+        return 0
+    result = runTest(commandName, tentativeMinimalFileName, candidates=batch)
+
+    if result == 'FAIL':
+        for symbol in batch:
+            markNodes(result, symbol)
+        acceptTentative()
+        return len(batch)
+
+    if len(batch) == 1:
+        markNodes(result, batch[0])
+        return 0
+
+    half = len(batch) / 2
+    return testBatch(batch[:half], precomputed) + \
+        testBatch(batch[half:], precomputed)
+
+
+def runBatchedPhase1(candidateGroup, comparator=None):
+    """Batches are ranked like the one-at-a-time loop ranks its nodes, by
+    the score of topScoringRemovableWUD for the preferences that have no
+    comparator (ADAPTIVE).
+    """
+    batchSize = 1
+    history = []
+    while (labelStore.countRemovableWUD(candidateGroup) > 0 and
+           not outOfTime()):
+        batch, precomputed = selectIndependentBatch(candidateGroup, batchSize,
+                                                    comparator)
+        if len(batch) == 0:
+            break
+
+        deleted = testBatch(batch, precomputed)
+
+        history = (history + [float(deleted) / len(batch)])[-batchHistoryLength:]
+        successRate = sum(history) / len(history)
+        if successRate >= 0.75:
+            batchSize *= 2
+        elif successRate < 0.25:
+            batchSize = max(batchSize / 2, 1)
+
+
 # def recursivelyDescend2(symbolRemoved, currentDeletionSet, result):
 #     testActuallyRun = True
 #     deletionSet = None
@@ -259,54 +683,581 @@ def removeNodeList(fileName, symbols):
 
 
 
+def crashingFunctionName(testFile):
+    """The function the compiler says it crashed in, None if it didn't say or
+    we can't see the compiler output.
+    """
+    if oracleCommand is not None or testServerPath is not None:
+        return None
+    status, output = runCompilerWithOutput(commandName, testFile)
+    return crashFunction(output)
+
+
+def reduceAroundCrashingFunction(name):
+    """Try removing every top level declaration that doesn't take the
+    function NAME with it, all in one test, bisecting only if that doesn't
+    keep the crash.
+    """
+    if name is None:
+        print "CRASH LOCALITY: NO FUNCTION NAMED"
+        return
+    QR = getQueryResult("allUnrelatedToFunction('%s', L)" % name)
+    unrelated = getSymbolList(QR)
+    testsBefore = numberOfTotalTests
+    deleted = testBatch(unrelated)
+    print "CRASH LOCALITY: IN %s, DELETED %d OF %d IN %d TESTS" % \
+        (name, deleted, len(unrelated), numberOfTotalTests - testsBefore)
+
+
+def sweep(name, query):
+    """Remove everything QUERY returns in one test, bisecting when that
+    doesn't keep the crash, until QUERY comes back empty. Every node tested
+    gets labelled, so each round is smaller than the one before.
+    """
+    testsBefore = numberOfTotalTests
+    deleted = 0
+    candidates = getSymbolList(getQueryResult(query))
+    while candidates and not outOfTime():
+        deleted += testBatch(candidates)
+        candidates = [symbol for symbol in
+                      getSymbolList(getQueryResult(query))
+                      if labelStore.isRemovable(symbol)]
+    print "SWEEP %s: DELETED %d IN %d TESTS" % \
+        (name, deleted, numberOfTotalTests - testsBefore)
+
+
+def runSweeps(crashingFunction):
+    sweep('DEAD DECLARATIONS', "allDeadDeclarations(L)")
+    # no function is named '', so without a name every body but main's goes
+    sweep('FUNCTION BODIES', "allStubbableBodies('%s', L)" %
+          (crashingFunction or ''))
+
+
+def readIncludeRegions(fileName):
+    """Returns the (begin, end) offsets of the includeRegion/3 facts."""
+    regions = []
+    with open(fileName) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith('includeRegion('):
+                continue
+            n, begin, end = line[len('includeRegion('):-2].split(',')
+            regions.append((int(begin), int(end)))
+    return regions
+
+
+def withoutRegions(contents, regions):
+    pieces = []
+    last = 0
+    for begin, end in sorted(regions):
+        pieces.append(contents[last:begin])
+        last = max(last, end)
+    pieces.append(contents[last:])
+    return ''.join(pieces)
+
+
+def reduceIncludeRegions(testFile):
+    """ddmin over the include regions of TESTFILE, before any constraints are
+    generated. Returns the name of the file that is left.
+    """
+    if os.path.exists(includeRegionsFileName):
+        os.remove(includeRegionsFileName)
+    call([constraintGenerator, "-plugin", "gen-include-regions", testFile],
+         stderr=open("/dev/null"))
+    if not os.path.exists(includeRegionsFileName):
+        return testFile
+    regions = readIncludeRegions(includeRegionsFileName)
+    with open(testFile) as f:
+        contents = f.read()
+    reducedFileName = "gamma%s" % os.path.splitext(testFile)[1]
+
+    def writeWithout(removed):
+        with open(reducedFileName, 'w') as f:
+            f.write(withoutRegions(contents, [regions[i] for i in removed]))
+
+    def testWithout(removed):
+        writeWithout(removed)
+        return runTest(commandName, reducedFileName,
+                       candidates=["region%d" % i for i in removed])
+
+    if runJournal is not None:
+        for op, indices in runJournal.records:
+            if op == journal.REGIONS:
+                writeWithout(map(int, indices))
+                print "INCLUDE REGIONS: RESUMED, REMOVED %d OF %d\n" % \
+                    (len(indices), len(regions))
+                return reducedFileName
+
+    testsBefore = numberOfTotalTests
+    removed = []
+    L = range(len(regions))
+    # header-heavy inputs often need none of their headers
+    if L and not outOfTime() and testWithout(L) == 'FAIL':
+        removed, L = L, []
+    n = 2
+    while len(L) >= 2 and not outOfTime():
+        some_complement_is_failing = False
+        for subset in split(L, n):
+            if testWithout(removed + subset) == 'FAIL':
+                removed = removed + subset
+                L = listminus(L, subset)
+                n = max(n-1, 2)
+                some_complement_is_failing = True
+                break
+        if not some_complement_is_failing:
+            if n == len(L):
+                break
+            n = min(n * 2, len(L))
+    writeWithout(removed)
+    if runJournal is not None:
+        runJournal.append(journal.REGIONS, [str(i) for i in removed])
+    print "INCLUDE REGIONS: REMOVED %d OF %d IN %d TESTS\n" % \
+        (len(removed), len(regions), numberOfTotalTests - testsBefore)
+    return reducedFileName
+
+
+def liveDependentsWithin(L):
+    inL = set(L)
+    dependents = {}
+    for symbol in L:
+        QR = getQueryResult("allLiveDependingOn(%s, L)" % symbol)
+        dependents[symbol] = [d for d in getSymbolList(QR) if d in inL]
+    return dependents
+
+
+def splitClosed(L, n, dependents):
+    """Like split(), but every subset also takes everything in L that depends
+    on one of its nodes, so that removing the subset never leaves a dangling
+    use behind. L should be in source order, which keeps nesting subtrees
+    together. Subsets may overlap; ones that would remove all of L or repeat
+    an earlier subset are dropped.
+    """
+    inL = set(L)
+    seen = set()
+    subsets = []
+    for subset in split(L, n):
+        closed = set(subset)
+        for symbol in subset:
+            closed.update([d for d in dependents.get(symbol, []) if d in inL])
+        key = frozenset(closed)
+        if len(closed) == len(L) or key in seen:
+            continue
+        seen.add(key)
+        subsets.append([symbol for symbol in L if symbol in closed])
+    return subsets
+
+
+def runsOwnTests(tool):
+    """Whether a tool that runs the test command itself (DDPhase2, TokenDD)
+    may: not when the tests go to an oracle or test server, have to be
+    traced or are capped in CPU time, none of which the tool knows about.
+    """
+    reason = None
+    if oracleCommand is not None:
+        reason = '--oracle'
+    elif testServerPath is not None:
+        reason = '--testServer'
+    elif traceRecorder is not None or traceReplayer is not None:
+        reason = 'a trace'
+    elif testLimits is not None and testLimits.cpuSeconds is not None:
+        reason = '--testCpuSeconds'
+    if reason is not None:
+        print "%s: NOT RUN WITH %s" % (tool, reason)
+        return False
+    return True
+
+
+def toolDeadlineArgs():
+    """Tell a tool about the time budget."""
+    if deadline is None:
+        return []
+    return ['-t', '%.3f' % max(deadline - time.time(), 0.0)]
+
+
+def toolLimits():
+    """What a tool runs between fork and exec for the --test* caps."""
+    if testLimits is None:
+        return None
+    return testLimits.applyToTool
+
+
+def runNativePhase2(L, dependents):
+    """Phase 2 in DDPhase2: the solver computes the deletion action of every
+    node in L once, and the tool applies them itself, testing numberOfJobs
+    candidates at a time, until the deadline if there is one. Returns the
+    nodes it kept, or None if the actions could not be computed.
+    """
+    global numberOfTotalTests
+    global numberOfUnresolvedTests
+    QR = getQueryResult("computeDeletionActionForList([%s], A)" % ', '.join(L))
+    if QR is None or isVariableNone(QR['A']):
+        print "DDPhase2: NO DELETION ACTIONS, PHASE 2 RUNS HERE"
+        return None
+    with open('deltas.txt', 'w') as f:
+        for symbol, action in zip(L, QR['A']):
+            f.write("%s %d %d %s\n" % (symbol, action.args[0],
+                                       action.args[1].args[0],
+                                       getValueFromAtom(action.args[1].args[1])))
+    args = [nativePhase2, '-j', str(numberOfJobs)] + toolDeadlineArgs()
+    if dependents is not None:
+        with open('dependencies.txt', 'w') as f:
+            for symbol in L:
+                for dependent in dependents.get(symbol, []):
+                    f.write("%s %s\n" % (symbol, dependent))
+        args += ['-c', 'dependencies.txt']
+    args += ['deltas.txt', currentMinimalFileName, tentativeMinimalFileName]
+    args += commandName.split()
+
+    process = subprocess.Popen(args, stdout=subprocess.PIPE,
+                               preexec_fn=toolLimits())
+    removed = []
+    for line in process.communicate()[0].splitlines():
+        if line.startswith('REMOVED '):
+            removed.append(line.split()[1])
+        elif line.startswith('TOTALTESTS: '):
+            numberOfTotalTests += int(line.split()[1])
+        elif line.startswith('NUMBEROFUNRESOLVEDTESTS: '):
+            numberOfUnresolvedTests += int(line.split()[1])
+    if process.returncode != 0:
+        print "DDPhase2: EXIT STATUS %d, PHASE 2 RUNS HERE" % \
+            process.returncode
+        return None
+
+    acceptTentative()
+    commitLabels(journal.DELETE, removed)
+    removedSet = set(removed)
+    return [symbol for symbol in L if symbol not in removedSet]
+
+
+def runTokenStage():
+    """Shrink the reduced file further at the token level with TokenDD,
+    keeping what it finds if it ran through or reached the deadline.
+    """
+    args = [tokenStage, '-j', str(numberOfJobs)] + toolDeadlineArgs()
+    args += ['-o', tentativeMinimalFileName, currentMinimalFileName]
+    args += commandName.split()
+    process = subprocess.Popen(args, stdout=subprocess.PIPE,
+                               preexec_fn=toolLimits())
+    tests = 0
+    for line in process.communicate()[0].splitlines():
+        if line.startswith('TOTALTESTS: '):
+            tests = int(line.split()[1])
+        elif line.startswith('TOKENS: '):
+            print "TOKEN STAGE %s" % line
+    if process.returncode == 0:
+        acceptTentative()
+    else:
+        print "TokenDD: EXIT STATUS %d, NOTHING KEPT" % process.returncode
+    print "TOKEN STAGE TESTS: %d\n" % tests
+
+
+def buildLabelStore(levels):
+    global labelStore
+    labelStore = LabelStore(
+        getSymbolList(getQueryResult("allRemovable(L)")),
+        getSymbolList(getQueryResult("allRemovableWUD(L)")), levels)
+
+
+def checkLabelStore():
+    """Catch the label store drifting from the solver, once per schedule
+    entry; from then on it has the solver's removable nodes.
+    """
+    differing = labelStore.sync(
+        getSymbolList(getQueryResult("allRemovable(L)")),
+        getSymbolList(getQueryResult("allRemovableWUD(L)")))
+    if differing:
+        print "LABEL STORE: %d NODES OUT OF STEP WITH THE SOLVER" % differing
+
+
+def topScoringAmong(comparator, candidates):
+    """The best of CANDIDATES by the prolog COMPARATOR, or random."""
+    QR = getQueryResult("topScoringAmong(%s, [%s], X)" %
+                        (comparator, ', '.join(candidates)))
+    if QR is None or isVariableNone(QR['X']):
+        return None
+    return getValueFromAtom(QR['X'])
+
+
+def runPhase1(schedule, preference, adaptiveOrdering=None,
+              reachabilityIndex=None):
+    for candidateGroup, comparator in schedule:
+        if batchDeletion:
+            runBatchedPhase1(candidateGroup, comparator)
+        candidates = labelStore.allRemovableWUD(candidateGroup)
+        while (candidates):
+            if outOfTime():
+                return
+            copy(currentMinimalFileName, tentativeMinimalFileName)
+
+            if adaptiveOrdering is not None:
+                symbolToRemove = adaptiveOrdering.choose(candidates)
+            elif reachabilityIndex is not None:
+                liveMask = reachabilityIndex.maskOf(labelStore.removable)
+                symbolToRemove = reachabilityIndex.topScoring(
+                    bitsetHeuristics[preference], candidates, liveMask)
+            else:
+                symbolToRemove = topScoringAmong(comparator, candidates)
+                if symbolToRemove is None:
+                    break
+            # if symbolToRemove == 'sym0':
+            #     import ipdb; ipdb.set_trace()
+
+            currentDeletionSet = removeNodeTransitively(tentativeMinimalFileName,
+                                                        symbolToRemove)
+            testStart = time.time()
+            result = runTest(commandName, tentativeMinimalFileName,
+                             candidates=currentDeletionSet or [symbolToRemove])
+            if adaptiveOrdering is not None:
+                adaptiveOrdering.record(symbolToRemove, result,
+                                        time.time() - testStart)
+            markNodes(result, symbolToRemove)
+
+            # import ipdb; ipdb.set_trace()
+            if result == 'FAIL':
+                acceptTentative()
+            # else:
+                # recursivelyDescend2(symbolToRemove, currentDeletionSet, result)
+            candidates = labelStore.allRemovableWUD(candidateGroup)
+        checkLabelStore()
+
+
+def independentComponents(dependencies, removable):
+    """Connected components of the implicitDependsOn graph restricted to the
+    REMOVABLE nodes. Nodes that can't be removed (isMain roots, essential
+    nodes, ...) stay put whatever happens, so they don't tie the reductions
+    of the nodes around them together.
+    """
+    parent = dict([(symbol, symbol) for symbol in removable])
+
+    def find(symbol):
+        root = symbol
+        while parent[root] != root:
+            root = parent[root]
+        while parent[symbol] != root:
+            parent[symbol], symbol = root, parent[symbol]
+        return root
+
+    for x, y in dependencies:
+        if x in parent and y in parent:
+            parent[find(x)] = find(y)
+
+    components = {}
+    for symbol in removable:
+        components.setdefault(find(symbol), []).append(symbol)
+    return components.values()
+
+
+def packComponents(components, numberOfBins):
+    """Longest-processing-time-first packing of components into bins."""
+    bins = [[] for i in xrange(numberOfBins)]
+    for component in sorted(components, key=len, reverse=True):
+        smallest = min(xrange(numberOfBins), key=lambda i: len(bins[i]))
+        bins[smallest].extend(component)
+    return [b for b in bins if b]
+
+
+def reduceComponentBin(task):
+    """Runs in a worker process forked from the driver: reduce the nodes in
+    one bin of components on a private scratch copy, with every other node
+    held fixed by marking it as having an untracked dependency.
+    """
+    global currentMinimalFileName
+    global tentativeMinimalFileName
+    global numberOfUnresolvedTests
+    global numberOfTotalTests
+    global bestFileName
+    global metrics
+    global testUsage
+    global runJournal
+    global traceRecorder
+    global removalSizes
+    binIndex, symbols = task
+    schedule, preference, reachabilityIndex, features, sourceFile = \
+        componentContext
+
+    currentMinimalFileName = 'alpha.%d.c' % binIndex
+    tentativeMinimalFileName = 'beta.%d.c' % binIndex
+    numberOfUnresolvedTests = 0
+    numberOfTotalTests = 0
+    if testUsage is not None:
+        testUsage = TestUsage()
+    # only the parent knows which of the bins' results survive the merge, so
+    # only the parent journals and traces what it commits after it.
+    # the metrics lock may have been held by the writer thread at the fork.
+    bestFileName = None
+    metrics = None
+    runJournal = None
+    traceRecorder = None
+    # the bins order their nodes by features alone
+    removalSizes = None
+    copy(sourceFile, currentMinimalFileName)
+
+    # the labels are the parent's as of the fork, which match sourceFile;
+    # the nodes of the bin have none yet
+    inBin = set(symbols)
+    outside = [symbol for symbol in labelStore.allRemovable()
+               if symbol not in inBin]
+    getQueryResult("markUntrackedList([%s])" % ', '.join(outside))
+    labelStore.mark(UNTRACKED, outside)
+
+    adaptiveOrdering = None
+    if features is not None:
+        adaptiveOrdering = AdaptiveOrdering(features)
+    runPhase1(schedule, preference, adaptiveOrdering, reachabilityIndex)
+
+    deleted = getSymbolList(getQueryResult("allPermanentlyDeleted(L)"))
+    essential = getSymbolList(getQueryResult("allEssentialForFailure(L)"))
+    untracked = getSymbolList(getQueryResult("allUntrackedDependencies(L)"))
+    for fileName in (currentMinimalFileName, tentativeMinimalFileName):
+        if os.path.exists(fileName):
+            os.remove(fileName)
+    return ([symbol for symbol in deleted if symbol in inBin],
+            [symbol for symbol in essential if symbol in inBin],
+            [symbol for symbol in untracked if symbol in inBin],
+            numberOfTotalTests, numberOfUnresolvedTests, testUsage)
+
+
+def reduceComponentsInParallel(schedule, preference, reachabilityIndex,
+                               features):
+    """Reduce the independent components of the input concurrently and merge
+    their deletions. The merged file is confirmed with one final test; if it
+    doesn't fail the way the original did, nothing is kept and the serial
+    loop starts from scratch.
+    """
+    global componentContext
+    global numberOfUnresolvedTests
+    global numberOfTotalTests
+
+    QR = getQueryResult("allImplicitDependencies(L)")
+    dependencies = [(getValueFromAtom(d.args[0]), getValueFromAtom(d.args[1]))
+                    for d in QR['L']]
+    components = independentComponents(dependencies,
+                                       labelStore.allRemovableWUD())
+    if len(components) < 2:
+        return
+
+    bins = packComponents(components, numberOfJobs)
+    componentContext = (schedule, preference, reachabilityIndex, features,
+                        currentMinimalFileName)
+    pool = multiprocessing.Pool(numberOfJobs)
+    results = pool.map(reduceComponentBin, list(enumerate(bins)), 1)
+    pool.close()
+    pool.join()
+
+    deleted = []
+    essential = []
+    untracked = []
+    for binDeleted, binEssential, binUntracked, total, unresolved, usage \
+            in results:
+        deleted.extend(binDeleted)
+        essential.extend(binEssential)
+        untracked.extend(binUntracked)
+        numberOfTotalTests += total
+        numberOfUnresolvedTests += unresolved
+        if usage is not None:
+            testUsage.merge(usage)
+
+    copy(currentMinimalFileName, tentativeMinimalFileName)
+    if deleted:
+        removeNodeList(tentativeMinimalFileName, deleted)
+    result = runTest(commandName, tentativeMinimalFileName, candidates=deleted)
+    print "COMPONENTS: %d IN %d BINS, MERGED: %s" % (len(components),
+                                                     len(bins), result)
+    if result != 'FAIL':
+        return
+
+    acceptTentative()
+    commitLabels(journal.DELETE, deleted)
+    commitLabels(journal.ESSENTIAL, essential)
+    commitLabels(journal.UNTRACKED, untracked)
+
+
 def invokeSDD(testFile, preference='RANDOM', ddmin=False):
     # import ipdb; ipdb.set_trace()
 
     global numberOfUnresolvedTests
     global numberOfTotalTests
+    global testUsage
     numberOfUnresolvedTests = 0
     numberOfTotalTests = 0
+    if testUsage is not None:
+        testUsage = TestUsage()
 
     QR = getQueryResult("clearAllLabels(L)")
     print "TOTAL NODES: %s" % str(len(QR['L']))
     copy(testFile, currentMinimalFileName)
+    saveBest()
 
-    searchHeuristic = None
+    # the comparators of topScoringRemovableWUD, ...2, ...R and ...A, applied
+    # to the removable nodes of the label store
+    comparator = None
     if preference=='TOP':
-        searchHeuristic = "topScoringRemovableWUD(X)"
+        comparator = 'sortAllDependingOnDescAllDependsOnDesc'
     elif preference=='BOTTOM':
-        searchHeuristic = "topScoringRemovableWUD2(X)"
+        comparator = 'sortAllDependsOnDescAllDependingOnDesc'
     elif preference == 'RANDOM':
-        searchHeuristic = "topScoringRemovableWUDR(X)"
+        comparator = 'random'
     elif preference == 'AVERAGE':
-        searchHeuristic = "topScoringRemovableWUDA(X)"
+        comparator = 'sortAllAverageDesc'
 
-    if ddmin:
-        getQueryResult("markAllUntrackedDependencies(L)")
+    features = None
+    adaptiveOrdering = None
+    if preference == 'ADAPTIVE':
+        QR = getQueryResult("allNodeFeatures(L)")
+        features = loadFeatures(QR['L'], getValueFromAtom)
+        adaptiveOrdering = AdaptiveOrdering(features)
+    if timeBudget is not None:
+        # against the clock, go for the most bytes per compiler second,
+        # counting everything a removal takes with it
+        QR = getQueryResult("allNodeFeatures(L)")
+        features = loadFeatures(QR['L'], getValueFromAtom)
+        QR = getQueryResult("allTransitiveRemovalSizes(L)")
+        global removalSizes
+        removalSizes = dict([(getValueFromAtom(t.args[0]), t.args[1])
+                             for t in QR['L']])
+        adaptiveOrdering = AdaptiveOrdering(features, removalSizes)
 
-    t0 = time.time()
-    while (getQueryResult("allRemovableWUD(L)")):
-        copy(currentMinimalFileName, tentativeMinimalFileName)
+    reachabilityIndex = None
+    if bitsetScoring and preference in bitsetHeuristics:
+        QR = getQueryResult("allImplicitDependencies(L)")
+        reachabilityIndex = ReachabilityIndex(
+            [(getValueFromAtom(d.args[0]), getValueFromAtom(d.args[1]))
+             for d in QR['L']])
 
-        QR = getQueryResult(searchHeuristic)
-        if QR is None or isVariableNone(QR['X']):
-            break
-        symbolToRemove = getValueFromAtom(QR['X'])
-        # if symbolToRemove == 'sym0':
-        #     import ipdb; ipdb.set_trace()
+    # each entry is reduced to a fixpoint before moving on to the next one
+    schedule = [(None, comparator)]
+    levels = None
+    if preference == 'LEVEL':
+        schedule = [(level, 'sortAllDependingOnDescAllDependsOnDesc')
+                    for level in reductionLevels]
+        QR = getQueryResult("allReductionLevels(L)")
+        levels = dict([(getValueFromAtom(l.args[0]), l.args[1])
+                       for l in QR['L']])
 
-        currentDeletionSet = removeNodeTransitively(tentativeMinimalFileName,
-                                                    symbolToRemove)
-        result = runTest(commandName, tentativeMinimalFileName)
-        markNodes(result, symbolToRemove)
+    buildLabelStore(levels)
 
-        # import ipdb; ipdb.set_trace()
-        if result == 'FAIL':
-            copy(tentativeMinimalFileName, currentMinimalFileName)
-        # else:
-            # recursivelyDescend2(symbolToRemove, currentDeletionSet, result)
+    if ddmin:
+        QR = getQueryResult("markAllUntrackedDependencies(L)")
+        labelStore.mark(UNTRACKED, getSymbolList(QR))
+
+    if runJournal is not None:
+        replayJournal()
+
+    enterPhase('phase1')
+    t0 = time.time()
+    if crashLocality or sweeps:
+        name = crashingFunctionName(testFile)
+    if crashLocality:
+        reduceAroundCrashingFunction(name)
+    if sweeps:
+        runSweeps(name)
+    if parallelComponents:
+        reduceComponentsInParallel(schedule, preference, reachabilityIndex,
+                                   features)
+    runPhase1(schedule, preference, adaptiveOrdering, reachabilityIndex)
 
     t1 = time.time() - t0
+    enterPhase('phase2')
     # Now run ddmin on nodes with untracked dependencies
     # QR = getQueryResult("allUntrackedDependencies(L)")
     QR = getQueryResult("allNotPermanentlyDeleted(L)")
@@ -323,20 +1274,43 @@ def invokeSDD(testFile, preference='RANDOM', ddmin=False):
         print "PHASE 1 UNRESOLVED: %d" % numberOfUnresolvedTests
         print "PHASE 1 TOTAL: %d\n" % numberOfTotalTests
 
+    dependents = None
+    if closedPartition:
+        QR = getQueryResult("allNotPermanentlyDeletedInSourceOrder(L)")
+        L = getSymbolList(QR)
+        dependents = liveDependentsWithin(L)
+
     # if not ddmin:
     #     n = len(L)
     copy(currentMinimalFileName, tentativeMinimalFileName)
-    while len(L) >= 2:
+    saveBest()
+    reducedNatively = False
+    if nativePhase2 is not None and len(L) >= 2 and not outOfTime() and \
+            runsOwnTests('DDPhase2'):
+        kept = runNativePhase2(L, dependents)
+        if kept is not None:
+            L = kept
+            reducedNatively = True
+    while len(L) >= 2 and not reducedNatively:
         # print L
-        subsets = split(L, n)
+        if dependents is None:
+            subsets = split(L, n)
+        else:
+            subsets = splitClosed(L, n, dependents)
         
         some_complement_is_failing = False
         for subset in subsets:
+            # don't start a test that can't finish before the deadline
+            if outOfTime(meanTestTime()):
+                print "PHASE 2: OUT OF TIME"
+                break
             complement = listminus(L, subset)
             removeNodeList(tentativeMinimalFileName, subset)
-            result = runTest(commandName, tentativeMinimalFileName)
+            result = runTest(commandName, tentativeMinimalFileName,
+                             candidates=subset)
             if result == 'FAIL':
-                copy(tentativeMinimalFileName, currentMinimalFileName)
+                acceptTentative()
+                commitLabels(journal.DELETE, subset)
                 L = complement
                 n = max(n-1, 2)
                 some_complement_is_failing = True
@@ -345,24 +1319,28 @@ def invokeSDD(testFile, preference='RANDOM', ddmin=False):
                 copy(currentMinimalFileName, tentativeMinimalFileName)
 
         if not some_complement_is_failing:
-            if n == len(L):
+            if n == len(L) or outOfTime(meanTestTime()):
                 break
             n = min(n * 2, len(L))
         
     # FIXME:HACK
     # import ipdb; ipdb.set_trace()
+    enterPhase('done')
     print "MINIMAL CASE: %s" % str(len(L))
     print "NUMBEROFUNRESOLVEDTESTS: %d" % numberOfUnresolvedTests
-    print "TOTALTESTS: %d\n===============================\n" % numberOfTotalTests
+    print "TOTALTESTS: %d" % numberOfTotalTests
+    if factCache is not None:
+        print "FACT CACHE: %s" % factCache.report()
+    if testUsage is not None:
+        print '\n'.join(testUsage.report())
+    print "===============================\n"
     # print L
     move(currentMinimalFileName, tentativeMinimalFileName)
-    with open(tentativeMinimalFileName) as ifile:
-        with open(currentMinimalFileName, 'w') as ofile:
-            for line in ifile:
-                lineStrip = line.strip()
-                if lineStrip == '' or lineStrip == ';':
-                    continue
-                ofile.write(line)
+    stripBlankLines(tentativeMinimalFileName, currentMinimalFileName)
+    saveBest()
+    if tokenStage is not None and not outOfTime() and \
+            runsOwnTests('TokenDD'):
+        runTokenStage()
 
 
 def main(argv=None):
@@ -371,6 +1349,8 @@ def main(argv=None):
 
     if argv is None:
         argv = sys.argv
+    # may be replaced by a cheaper one, see --calibrate
+    global commandName
 
     parser = optparse.OptionParser(usage='%prog [options] fileName')
     parser.add_option('-v', '--verbose', action='store_true', default=False,
@@ -383,6 +1363,90 @@ def main(argv=None):
                       help = 'pick nodes randomly')
     parser.add_option('-a', '--averagePreferred', action='store_true', default=False,
                       help = 'pick nodes on weighted average')
+    parser.add_option('-o', '--adaptivePreferred', action='store_true', default=False,
+                      help = 'pick nodes by expected bytes removed per second, learnt while running')
+    parser.add_option('-l', '--levelPreferred', action='store_true', default=False,
+                      help = 'reduce declarations, then statements, then expressions')
+    parser.add_option('-x', '--bitsetScoring', action='store_true', default=False,
+                      help = 'score -t/-a/-l and the default heuristic from a bitset reachability index')
+    parser.add_option('-p', '--parallelComponents', action='store_true', default=False,
+                      help = 'reduce independent components in parallel first')
+    parser.add_option('-j', '--jobs', action='store', type='int',
+                      default=multiprocessing.cpu_count(),
+                      help = 'number of worker processes')
+    parser.add_option('-c', '--closedPartition', action='store_true', default=False,
+                      help = 'split phase 2 into dependency-closed subsets')
+    parser.add_option('--nativePhase2', action='store', default=None,
+                      help = 'run phase 2 in this DDPhase2 binary, -j candidates at a time')
+    parser.add_option('--tokenStage', action='store', default=None,
+                      help = 'finish with token-level ddmin in this TokenDD binary')
+    parser.add_option('--journal', action='store', default=None,
+                      help = 'journal committed deletions and labels to this file')
+    parser.add_option('--resume', action='store_true', default=False,
+                      help = 'pick up the run recorded in the --journal file')
+    parser.add_option('--recordTrace', action='store', default=None,
+                      help = 'record every test and its outcome to this file')
+    parser.add_option('--replayTrace', action='store', default=None,
+                      help = 'take test outcomes from this trace instead of the compiler')
+    parser.add_option('--timeBudget', action='store', type='float',
+                      default=None,
+                      help = 'stop after this many seconds with the best result so far')
+    parser.add_option('--bestFile', action='store', default=None,
+                      help = 'where --timeBudget keeps the best result so far (minimal with the extension of the input)')
+    parser.add_option('--testServer', action='store', default=None,
+                      help = 'run the tests through the reduction daemon listening on this socket')
+    parser.add_option('--jobId', action='store', default='0',
+                      help = 'job the tests are run for, see --testServer')
+    parser.add_option('--constraintGenerator', action='store', default=None,
+                      help = 'path to the GenerateConstraints binary')
+    parser.add_option('--metricsFile', action='store', default=None,
+                      help = 'rewrite live metrics to this file every few seconds')
+    parser.add_option('--metricsPort', action='store', type='int',
+                      default=None,
+                      help = 'serve live metrics over HTTP on this local port')
+    parser.add_option('--oracle', action='store', default=None,
+                      help = 'persistent oracle command answering TEST requests on stdin')
+    parser.add_option('--oracleContents', action='store_true', default=False,
+                      help = 'send the oracle file contents instead of paths')
+    parser.add_option('--oracleTimeout', action='store', type='float',
+                      default=None,
+                      help = 'restart the oracle when a test takes longer (seconds)')
+    parser.add_option('--oracleMaxRss', action='store', type='int',
+                      default=None,
+                      help = 'restart the oracle when it grows past this many MB')
+    parser.add_option('--oracleMaxTests', action='store', type='int',
+                      default=None,
+                      help = 'restart the oracle after this many tests')
+    parser.add_option('--calibrate', action='store_true', default=False,
+                      help = 'look for a cheaper test command with the same crash signature')
+    parser.add_option('-f', '--crashLocality', action='store_true', default=False,
+                      help = 'first remove what the function the compiler crashed in does not need')
+    parser.add_option('-w', '--sweeps', action='store_true', default=False,
+                      help = 'first sweep out dead declarations and function bodies in bulk')
+    parser.add_option('-i', '--includeRegions', action='store_true', default=False,
+                      help = 'first ddmin over the #include lines and line marker regions')
+    parser.add_option('-b', '--batch', action='store_true', default=False,
+                      help = 'remove batches of independent nodes per test')
+    parser.add_option('-m', '--mainFileOnly', action='store_true', default=False,
+                      help = 'only generate constraints for the main file')
+    parser.add_option('-e', '--editableFile', action='append', default=[],
+                      help = 'also generate constraints for this file (implies -m)')
+    parser.add_option('--generatorJobs', type='int', default=1,
+                      help = 'threads the constraint generator scans source ranges with')
+    parser.add_option('--testMemoryMB', type='int', default=None,
+                      help = 'cap the address space of every compiler process at this many MB')
+    parser.add_option('--testCpuSeconds', type='int', default=None,
+                      help = 'cap the CPU time of every compiler process')
+    parser.add_option('--testOutputMB', type='int', default=None,
+                      help = 'cap what a compiler run writes and prints at this many MB')
+    parser.add_option('--measureTests', action='store_true', default=False,
+                      help = 'record peak RSS and CPU time of every compiler run (implied by the caps)')
+    parser.add_option('--factCache', action='store', default=None,
+                      help = 'reuse the generated facts of earlier runs from this directory')
+    parser.add_option('--factCacheEntries', type='int', default=64,
+                      help = 'keep this many inputs in the --factCache')
+    parser.add_option('--factCacheMB', type='int', default=None,
+                      help = 'keep the --factCache under this many MB')
 
 
     options, args = parser.parse_args(argv[1:])
@@ -393,10 +1457,98 @@ def main(argv=None):
     if not (os.path.exists(testFile) and os.path.isfile(testFile)):
         parser.error('make sure input file "%s" exists' % testFile)
 
-    result = runTest(commandName, testFile, False)
-    if result != 'FAIL':
-        return
+    global testServerPath
+    testServerPath = options.testServer
+    global jobId
+    jobId = options.jobId
+
+    global oracleCommand
+    oracleCommand = options.oracle
+    global oracleOptions
+    oracleOptions = {'sendContents': options.oracleContents,
+                     'timeout': options.oracleTimeout,
+                     'maxTests': options.oracleMaxTests}
+    if options.oracleMaxRss is not None:
+        oracleOptions['maxRss'] = options.oracleMaxRss * 1024 * 1024
+
+    limits = resourceLimits(options.testMemoryMB, options.testCpuSeconds,
+                            options.testOutputMB)
+    if limits.any() or options.measureTests:
+        global testLimits
+        testLimits = limits
+        global testUsage
+        testUsage = TestUsage()
+
+    if options.replayTrace is None:
+        result = runTest(commandName, testFile, False)
+        if result != 'FAIL':
+            return
+
+    originalCommandName = commandName
+    signature = None
+    if options.calibrate and options.oracle is None:
+        commandName, signature, measurements = calibrate(commandName, testFile)
+        for variant, seconds, variantSignature in measurements:
+            print "CALIBRATION: %.3fs %s: %s" % (seconds, variant,
+                                                variantSignature)
+        print "TEST COMMAND: %s\n" % commandName
         
+    global batchDeletion
+    batchDeletion = options.batch
+    global bitsetScoring
+    bitsetScoring = options.bitsetScoring
+    global parallelComponents
+    parallelComponents = options.parallelComponents
+    global numberOfJobs
+    numberOfJobs = max(options.jobs, 1)
+    global closedPartition
+    closedPartition = options.closedPartition
+    global nativePhase2
+    nativePhase2 = options.nativePhase2
+    global tokenStage
+    tokenStage = options.tokenStage
+    global crashLocality
+    crashLocality = options.crashLocality
+    global sweeps
+    sweeps = options.sweeps
+    if options.resume and options.journal is None:
+        parser.error('--resume needs --journal')
+    if options.constraintGenerator is not None:
+        global constraintGenerator
+        constraintGenerator = options.constraintGenerator
+    global timeBudget
+    timeBudget = options.timeBudget
+    if options.timeBudget is not None:
+        # the budget covers constraint generation too
+        global deadline
+        deadline = time.time() + options.timeBudget
+        global bestFileName
+        bestFileName = options.bestFile
+        if bestFileName is None:
+            bestFileName = "minimal%s" % os.path.splitext(testFile)[1]
+    if options.recordTrace is not None and options.replayTrace is not None:
+        parser.error('--recordTrace and --replayTrace are exclusive')
+    # every test after the initial check is traced, the ones on the include
+    # regions as well as the reduction's
+    global traceRecorder
+    global traceReplayer
+    if options.recordTrace is not None:
+        traceRecorder = TraceRecorder(options.recordTrace, testFile)
+    if options.replayTrace is not None:
+        traceReplayer = TraceReplayer(options.replayTrace, testFile)
+    if (options.recordTrace is not None or options.replayTrace is not None) \
+            and parallelComponents:
+        # worker processes would interleave their tests in the trace
+        print "TRACE: RUNNING COMPONENTS SERIALLY"
+        parallelComponents = False
+    # keyed on the input as given, which the include regions are cut from
+    global runJournal
+    if options.journal is not None:
+        try:
+            runJournal = Journal(options.journal, testFile, options.resume)
+        except JournalMismatch, e:
+            parser.error(str(e))
+
     preference = 'BOTTOM'
     if options.topPreferred:
         preference = 'TOP'
@@ -404,15 +1556,63 @@ def main(argv=None):
         preference = 'RANDOM'
     if options.averagePreferred:
         preference = 'AVERAGE'
+    if options.levelPreferred:
+        preference = 'LEVEL'
+    if options.adaptivePreferred:
+        preference = 'ADAPTIVE'
 
     # stderr = None
     # if not options.verbose:
     #     stderr = open('/dev/null')
 
-    s = 'call(["%s", "-plugin", "gen-constraints","%s"],stderr=open("/dev/null"))' % (constraintGenerator, testFile)
+    if options.includeRegions:
+        testFile = reduceIncludeRegions(testFile)
+
+    pluginArgs = []
+    if options.mainFileOnly:
+        pluginArgs.append("main-only")
+    for editableFile in options.editableFile:
+        pluginArgs.append("editable=%s" % editableFile)
+    if options.generatorJobs > 1:
+        pluginArgs.append("jobs=%d" % options.generatorJobs)
+    factsKey = None
+    if options.factCache is not None:
+        global factCache
+        maxBytes = None
+        if options.factCacheMB is not None:
+            maxBytes = options.factCacheMB * 1024 * 1024
+        factCache = FactCache(options.factCache, options.factCacheEntries,
+                              maxBytes)
+        # the thread count does not change the facts
+        factsKey = factCache.key(testFile, constraintGenerator,
+                                 [arg for arg in pluginArgs
+                                  if not arg.startswith('jobs=')],
+                                 options.editableFile)
+    pluginArgs = ''.join(['"-plugin-arg-gen-constraints", "%s", ' % arg
+                          for arg in pluginArgs])
+
+    metricsWriter = None
+    if options.metricsFile is not None or options.metricsPort is not None:
+        metricsWriter = startMetrics(options.metricsFile, options.metricsPort)
+    enterPhase('generation')
+
+    s = 'call(["%s", "-plugin", "gen-constraints", %s"%s"],stderr=open("/dev/null"))' % (constraintGenerator, pluginArgs, testFile)
     setup = "from subprocess import call"
     t = timeit.Timer(stmt=s, setup=setup)
-    print "CONSTRAINT GENERATION: %s\n" % str(t.timeit(5)/5)
+    # a journalled, traced or timed run is not repeatable
+    runs = 5
+    if options.journal is not None or options.recordTrace is not None or \
+            options.replayTrace is not None or options.timeBudget is not None:
+        runs = 1
+    if factCache is not None and factCache.fetch(factsKey, 'out.txt'):
+        print "CONSTRAINT GENERATION: CACHED\n"
+    else:
+        if factCache is not None and os.path.exists('out.txt'):
+            # only fresh facts go into the cache
+            os.remove('out.txt')
+        print "CONSTRAINT GENERATION: %s\n" % str(t.timeit(runs)/runs)
+        if factCache is not None:
+            factCache.store(factsKey, 'out.txt')
 
     for item in sources:
         prolog.consult(item)
@@ -422,7 +1622,27 @@ def main(argv=None):
     setup = "from __main__ import invokeSDD"
     t = timeit.Timer(stmt=s, setup=setup)
     # invokeSDD(testFile, options.topPreferred, options.ddmin)
-    print "TIME TAKEN: %s" % str(t.timeit(5)/5)
+    print "TIME TAKEN: %s" % str(t.timeit(runs)/runs)
+    if runJournal is not None:
+        runJournal.close()
+        runJournal = None
+    if traceRecorder is not None:
+        traceRecorder.close()
+        traceRecorder = None
+    if traceReplayer is not None:
+        traceReplayer.report()
+        traceReplayer = None
+    if commandName != originalCommandName:
+        same, actual = recheck(originalCommandName, currentMinimalFileName,
+                               signature)
+        if same:
+            print "RECHECK: SAME SIGNATURE WITH %s" % originalCommandName
+        else:
+            print "RECHECK: %s NOW GIVES %s" % (originalCommandName, actual)
+    if metricsWriter is not None:
+        metricsWriter.stop()
+    if persistentOracle is not None:
+        persistentOracle[1].stop()
 
 ###############################################################################
 if __name__ == '__main__':
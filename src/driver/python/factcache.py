@@ -0,0 +1,174 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""On-disk cache of the facts GenerateConstraints writes to out.txt.
+
+Retrying a reduction with another heuristic parses the same input again; with
+the cache it copies the facts from the last time instead. An entry is keyed
+on the sha1 of
+
+    the input bytes, and those of the -e files,
+    the plugin arguments,
+    the generator: its GNU build ID, or the sha1 of the binary without one.
+
+Headers the input includes are not part of the key; reproducers are usually
+preprocessed, and ones that aren't are assumed to see the same headers.
+
+Entries are files <key>.txt in the cache directory. A hit touches its entry,
+so evicting the oldest entries by modification time first is least recently
+used; the cache is kept to MAXENTRIES entries and, if given, MAXBYTES bytes.
+New entries are written to a temporary file and renamed, so concurrent runs
+sharing a directory never read a partial one.
+"""
+
+import hashlib
+import os
+import shutil
+import struct
+import tempfile
+
+NT_GNU_BUILD_ID = 3
+SHT_NOTE = 7
+
+
+def gnuBuildId(fileName):
+    """The GNU build ID note of an ELF file as hex, or None."""
+    try:
+        with open(fileName, 'rb') as f:
+            ident = f.read(16)
+            if len(ident) < 16 or ident[:4] != '\x7fELF':
+                return None
+            is64 = ident[4] == '\x02'
+            endian = ident[5] == '\x02' and '>' or '<'
+            if is64:
+                f.seek(0x28)
+                shoff, = struct.unpack(endian + 'Q', f.read(8))
+                f.seek(0x3a)
+            else:
+                f.seek(0x20)
+                shoff, = struct.unpack(endian + 'I', f.read(4))
+                f.seek(0x2e)
+            shentsize, shnum = struct.unpack(endian + 'HH', f.read(4))
+
+            for i in xrange(shnum):
+                f.seek(shoff + i * shentsize)
+                header = f.read(shentsize)
+                if is64:
+                    shtype, = struct.unpack(endian + 'I', header[4:8])
+                    offset, size = struct.unpack(endian + 'QQ', header[24:40])
+                else:
+                    shtype, = struct.unpack(endian + 'I', header[4:8])
+                    offset, size = struct.unpack(endian + 'II', header[16:24])
+                if shtype != SHT_NOTE:
+                    continue
+
+                f.seek(offset)
+                notes = f.read(size)
+                position = 0
+                while position + 12 <= len(notes):
+                    namesz, descsz, notetype = \
+                        struct.unpack(endian + 'III',
+                                      notes[position:position + 12])
+                    name = position + 12
+                    desc = name + ((namesz + 3) & ~3)
+                    if notetype == NT_GNU_BUILD_ID and \
+                            notes[name:name + namesz] == 'GNU\0':
+                        return notes[desc:desc + descsz].encode('hex')
+                    position = desc + ((descsz + 3) & ~3)
+    except (IOError, struct.error):
+        pass
+    return None
+
+
+def fileSha1(fileName):
+    digest = hashlib.sha1()
+    with open(fileName, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 20), ''):
+            digest.update(chunk)
+    return digest.hexdigest()
+
+
+def generatorIdentity(fileName):
+    buildId = gnuBuildId(fileName)
+    if buildId is not None:
+        return 'build-id ' + buildId
+    return 'sha1 ' + fileSha1(fileName)
+
+
+class FactCache(object):
+    def __init__(self, directory, maxEntries=64, maxBytes=None):
+        self.directory = directory
+        self.maxEntries = maxEntries
+        self.maxBytes = maxBytes
+        self.hits = 0
+        self.misses = 0
+        self.evictions = 0
+        if not os.path.isdir(directory):
+            os.makedirs(directory)
+
+    def key(self, inputFileName, generator, arguments, editableFileNames=[]):
+        digest = hashlib.sha1()
+        for fileName in [inputFileName] + list(editableFileNames):
+            digest.update(fileSha1(fileName) + '\n')
+        digest.update('\0'.join(arguments) + '\n')
+        digest.update(generatorIdentity(generator) + '\n')
+        return digest.hexdigest()
+
+    def entry(self, key):
+        return os.path.join(self.directory, key + '.txt')
+
+    def fetch(self, key, factsFileName):
+        """Copies the facts for KEY to FACTSFILENAME; False on a miss."""
+        entry = self.entry(key)
+        try:
+            shutil.copyfile(entry, factsFileName)
+        except IOError:
+            self.misses += 1
+            return False
+        os.utime(entry, None)
+        self.hits += 1
+        return True
+
+    def store(self, key, factsFileName):
+        if not os.path.exists(factsFileName):
+            return
+        handle, temporary = tempfile.mkstemp(dir=self.directory,
+                                             suffix='.tmp')
+        os.close(handle)
+        shutil.copyfile(factsFileName, temporary)
+        os.rename(temporary, self.entry(key))
+        self.evict()
+
+    def entries(self):
+        """(mtime, size, path) of every entry, oldest first."""
+        result = []
+        for name in os.listdir(self.directory):
+            if not name.endswith('.txt'):
+                continue
+            path = os.path.join(self.directory, name)
+            try:
+                info = os.stat(path)
+            except OSError:
+                continue
+            result.append((info.st_mtime, info.st_size, path))
+        result.sort()
+        return result
+
+    def evict(self):
+        entries = self.entries()
+        total = sum([size for mtime, size, path in entries])
+        # the newest entry always stays, however big it is
+        while len(entries) > 1 and \
+                (len(entries) > self.maxEntries or
+                 (self.maxBytes is not None and total > self.maxBytes)):
+            mtime, size, path = entries.pop(0)
+            try:
+                os.remove(path)
+            except OSError:
+                pass
+            total -= size
+            self.evictions += 1
+
+    def report(self):
+        return "%d HITS, %d MISSES, %d EVICTIONS" % (self.hits, self.misses,
+                                                     self.evictions)
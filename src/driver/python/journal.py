@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Append-only journal of the decisions a reduction commits to.
+
+The first line identifies the input (its sha1 and name); every following line
+is one committed label change:
+
+    delete sym1 sym2 ...       nodes permanently deleted (and gone from the file)
+    essential sym3 ...         nodes marked isEssentialForFailure
+    untracked sym4 ...         nodes marked hasUntrackedDependency
+    regions 0 3 ...            include regions removed before the constraints
+                               were generated (always written, even if empty)
+
+Lines are flushed right away and fsync'd in batches. A line that was cut
+short by a crash has no trailing newline and is ignored when reading back.
+"""
+
+import hashlib
+import os
+import time
+
+DELETE = 'delete'
+ESSENTIAL = 'essential'
+UNTRACKED = 'untracked'
+REGIONS = 'regions'
+
+
+def fileDigest(fileName):
+    with open(fileName, 'rb') as f:
+        return hashlib.sha1(f.read()).hexdigest()
+
+
+class JournalMismatch(Exception):
+    pass
+
+
+class Journal(object):
+    def __init__(self, fileName, inputFileName, resume=False, syncEvery=64,
+                 syncInterval=5.0):
+        self.fileName = fileName
+        self.syncEvery = syncEvery
+        self.syncInterval = syncInterval
+        self.pending = 0
+        self.lastSync = time.time()
+
+        digest = fileDigest(inputFileName)
+        self.records = []
+        if resume:
+            header, self.records = readJournal(fileName)
+            if header is None or header[0] != digest:
+                raise JournalMismatch("%s was not written for %s" %
+                                      (fileName, inputFileName))
+            self.handle = open(fileName, 'a')
+        else:
+            self.handle = open(fileName, 'w')
+            self.handle.write("input %s %s\n" % (digest, inputFileName))
+            self.sync()
+
+    def append(self, op, symbols):
+        if not symbols and op != REGIONS:
+            return
+        self.handle.write(' '.join([op] + symbols) + '\n')
+        self.handle.flush()
+        self.pending += 1
+        if (self.pending >= self.syncEvery or
+            time.time() - self.lastSync >= self.syncInterval):
+            self.sync()
+
+    def sync(self):
+        self.handle.flush()
+        os.fsync(self.handle.fileno())
+        self.pending = 0
+        self.lastSync = time.time()
+
+    def close(self):
+        self.sync()
+        self.handle.close()
+
+
+def readJournal(fileName):
+    """Returns ((digest, inputFileName), [(op, [symbols])])."""
+    header = None
+    records = []
+    with open(fileName) as f:
+        for line in f:
+            if not line.endswith('\n'):
+                break
+            fields = line.split()
+            if not fields:
+                continue
+            if header is None:
+                if fields[0] != 'input' or len(fields) < 3:
+                    break
+                header = (fields[1], ' '.join(fields[2:]))
+                continue
+            records.append((fields[0], fields[1:]))
+    return header, records
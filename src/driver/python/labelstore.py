@@ -0,0 +1,111 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Driver-side copy of the removable nodes.
+
+The set of removable nodes, with and without the ones that have an untracked
+dependency, is kept here and updated only for the nodes whose labels change,
+so asking what is still removable doesn't cost a setof over every symbol in
+prolog. The search heuristics are handed these lists instead of building
+their own.
+
+The labels themselves live in prolog only; the label predicates that take an
+extra list argument (permanentlyDelete/2, recursivelyMarkEssential/2, ...)
+report the nodes they touched and those lists are fed in here. sync()
+compares the sets with the solver's and takes the solver's on a difference.
+"""
+
+import bisect
+
+DELETED = 'hasBeenDeleted'
+PERMANENTLY_DELETED = 'hasBeenPermanentlyDeleted'
+ESSENTIAL = 'isEssentialForFailure'
+UNTRACKED = 'hasUntrackedDependency'
+
+
+class SortedSymbols(object):
+    """Symbols in the order setof gives them, kept sorted as they are
+    discarded so they never have to be sorted again.
+    """
+    def __init__(self, symbols=()):
+        self.members = set(symbols)
+        self.ordered = sorted(self.members)
+
+    def __len__(self):
+        return len(self.ordered)
+
+    def __iter__(self):
+        return iter(self.ordered)
+
+    def __contains__(self, symbol):
+        return symbol in self.members
+
+    def discard(self, symbol):
+        if symbol in self.members:
+            self.members.remove(symbol)
+            del self.ordered[bisect.bisect_left(self.ordered, symbol)]
+
+
+class LabelStore(object):
+    def __init__(self, removable, removableWUD, groups=None):
+        """REMOVABLE are the nodes that are removable, REMOVABLEWUD those of
+        them without an untracked dependency. GROUPS optionally maps a node
+        to a group (e.g. its reduction level) so that the removable set of
+        one group can be asked for directly.
+        """
+        self.groups = groups or {}
+        self.reset(removable, removableWUD)
+
+    def reset(self, removable, removableWUD):
+        self.removable = SortedSymbols(removable)
+        self.removableWUD = SortedSymbols(removableWUD)
+        byGroup = {}
+        for symbol in self.removableWUD:
+            byGroup.setdefault(self.groups.get(symbol), []).append(symbol)
+        self.removableWUDByGroup = dict(
+            [(group, SortedSymbols(symbols))
+             for group, symbols in byGroup.items()])
+
+    def isRemovable(self, symbol):
+        return symbol in self.removable
+
+    def mark(self, label, symbols):
+        if label in (PERMANENTLY_DELETED, ESSENTIAL):
+            for symbol in symbols:
+                self.removable.discard(symbol)
+        if label in (PERMANENTLY_DELETED, ESSENTIAL, UNTRACKED):
+            for symbol in symbols:
+                self.removableWUD.discard(symbol)
+                group = self.removableWUDByGroup.get(self.groups.get(symbol))
+                if group is not None:
+                    group.discard(symbol)
+
+    def countRemovableWUD(self, group=None):
+        if group is None:
+            return len(self.removableWUD)
+        return len(self.removableWUDByGroup.get(group, ()))
+
+    def allRemovableWUD(self, group=None):
+        """Sorted like the setof in allRemovableWUD/1. The list is the
+        store's own and changes with it; don't modify it.
+        """
+        if group is None:
+            return self.removableWUD.ordered
+        if group not in self.removableWUDByGroup:
+            return []
+        return self.removableWUDByGroup[group].ordered
+
+    def allRemovable(self):
+        return self.removable.ordered
+
+    def sync(self, removable, removableWUD):
+        """Compares the store with the solver's REMOVABLE and REMOVABLEWUD
+        nodes and takes those if they differ. Returns how many nodes did.
+        """
+        differing = len(self.removable.members.symmetric_difference(
+            removable))
+        differing += len(self.removableWUD.members.symmetric_difference(
+            removableWUD))
+        if differing:
+            self.reset(removable, removableWUD)
+        return differing
@@ -0,0 +1,175 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Counters, gauges and histograms of a running reduction, rendered in the
+Prometheus text format.
+
+Updating a metric is a dictionary update under one lock; everything else
+(rendering, computed gauges, writing the file, serving HTTP) happens in a
+background thread, off the test loop. Computed gauges are functions that
+are called only when the metrics are rendered.
+"""
+
+from __future__ import with_statement
+
+import BaseHTTPServer
+import os
+import threading
+
+# upper bounds of the test duration histogram, in seconds
+defaultBuckets = [0.01, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0]
+
+
+def labelString(labels):
+    if not labels:
+        return ''
+    return '{%s}' % ','.join(['%s="%s"' % (k, v) for k, v in labels])
+
+
+class Histogram(object):
+    def __init__(self, buckets):
+        self.buckets = buckets
+        self.counts = [0] * len(buckets)
+        self.count = 0
+        self.sum = 0.0
+
+    def observe(self, value):
+        for i in xrange(len(self.buckets)):
+            if value <= self.buckets[i]:
+                self.counts[i] += 1
+                break
+        self.count += 1
+        self.sum += value
+
+
+class Metrics(object):
+    def __init__(self, prefix='sdd'):
+        self.prefix = prefix
+        self.lock = threading.Lock()
+        self.help = {}
+        self.types = {}
+        # (name, labels) -> value, labels being a tuple of (key, value)
+        self.counters = {}
+        self.gauges = {}
+        self.computedGauges = {}
+        self.histograms = {}
+
+    def describe(self, name, metricType, helpText):
+        self.types[name] = metricType
+        self.help[name] = helpText
+
+    def increment(self, name, labels=(), amount=1):
+        with self.lock:
+            key = (name, labels)
+            self.counters[key] = self.counters.get(key, 0) + amount
+
+    def set(self, name, value, labels=()):
+        with self.lock:
+            self.gauges[(name, labels)] = value
+
+    def compute(self, name, function, labels=()):
+        with self.lock:
+            self.computedGauges[(name, labels)] = function
+
+    def observe(self, name, value, labels=(), buckets=defaultBuckets):
+        with self.lock:
+            key = (name, labels)
+            if key not in self.histograms:
+                self.histograms[key] = Histogram(buckets)
+            self.histograms[key].observe(value)
+
+    def render(self):
+        with self.lock:
+            samples = self.counters.items() + self.gauges.items()
+            computed = self.computedGauges.items()
+            histograms = [(key, list(h.buckets), list(h.counts), h.count,
+                           h.sum) for key, h in self.histograms.items()]
+        for key, function in computed:
+            try:
+                samples.append((key, function()))
+            except Exception:
+                pass
+
+        byName = {}
+        for (name, labels), value in sorted(samples):
+            byName.setdefault(name, []).append(
+                "%s_%s%s %s" % (self.prefix, name, labelString(labels), value))
+        for (name, labels), buckets, counts, count, total in histograms:
+            lines = byName.setdefault(name, [])
+            cumulative = 0
+            for bound, bucketCount in zip(buckets, counts):
+                cumulative += bucketCount
+                lines.append("%s_%s_bucket%s %d" %
+                             (self.prefix, name,
+                              labelString(labels + (('le', bound),)),
+                              cumulative))
+            lines.append("%s_%s_bucket%s %d" %
+                         (self.prefix, name,
+                          labelString(labels + (('le', '+Inf'),)), count))
+            lines.append("%s_%s_sum%s %s" %
+                         (self.prefix, name, labelString(labels), total))
+            lines.append("%s_%s_count%s %d" %
+                         (self.prefix, name, labelString(labels), count))
+
+        output = []
+        for name in sorted(byName.keys()):
+            if name in self.help:
+                output.append("# HELP %s_%s %s" % (self.prefix, name,
+                                                   self.help[name]))
+                output.append("# TYPE %s_%s %s" % (self.prefix, name,
+                                                   self.types[name]))
+            output.extend(byName[name])
+        return '\n'.join(output) + '\n'
+
+    def writeFile(self, fileName):
+        temporaryFileName = "%s.tmp" % fileName
+        with open(temporaryFileName, 'w') as f:
+            f.write(self.render())
+        os.rename(temporaryFileName, fileName)
+
+
+class MetricsWriter(threading.Thread):
+    """Rewrites FILENAME every INTERVAL seconds until stopped."""
+
+    def __init__(self, metrics, fileName, interval=5.0):
+        threading.Thread.__init__(self)
+        self.setDaemon(True)
+        self.metrics = metrics
+        self.fileName = fileName
+        self.interval = interval
+        self.stopped = threading.Event()
+
+    def run(self):
+        while not self.stopped.isSet():
+            self.metrics.writeFile(self.fileName)
+            self.stopped.wait(self.interval)
+
+    def stop(self):
+        self.stopped.set()
+        self.join()
+        self.metrics.writeFile(self.fileName)
+
+
+def serveMetrics(metrics, port, host='127.0.0.1'):
+    """Serve the metrics at http://HOST:PORT/metrics from a daemon thread."""
+
+    class MetricsHandler(BaseHTTPServer.BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path.split('?')[0] not in ('/', '/metrics'):
+                self.send_error(404)
+                return
+            body = metrics.render()
+            self.send_response(200)
+            self.send_header('Content-Type', 'text/plain; version=0.0.4')
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, format, *args):
+            pass
+
+    server = BaseHTTPServer.HTTPServer((host, port), MetricsHandler)
+    thread = threading.Thread(target=server.serve_forever)
+    thread.setDaemon(True)
+    thread.start()
+    return server
@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Persistent interestingness oracle.
+
+Instead of starting the test command once per test, the driver starts the
+oracle once and talks to it over its stdin and stdout, one test at a time:
+
+    driver -> oracle    TEST <path>\\n
+                   or   DATA <length>\\n<length bytes of file contents>
+    oracle -> driver    PASS\\n | FAIL\\n | UNRESOLVED\\n
+
+with the same meaning as the outcomes of runTest. Anything else written to
+stdout is an error. When the oracle's stdin is closed it should exit.
+
+The oracle is restarted when it dies, answers garbage, takes longer than
+the timeout, grows past the resident set limit or has answered the maximum
+number of tests. A test that was in flight when the oracle went down is
+retried once on a fresh oracle, then counted UNRESOLVED.
+"""
+
+import os
+import select
+import shlex
+import signal
+import subprocess
+import time
+
+from outcome import OUTCOMES
+
+
+class OracleError(Exception):
+    pass
+
+
+def residentSetSize(pid):
+    """Resident set size of process PID in bytes, None if unknown."""
+    try:
+        statusFile = open('/proc/%d/status' % pid)
+    except IOError:
+        return None
+    try:
+        for line in statusFile:
+            if line.startswith('VmRSS:'):
+                return int(line.split()[1]) * 1024
+    finally:
+        statusFile.close()
+    return None
+
+
+class PersistentOracle(object):
+    def __init__(self, command, sendContents=False, timeout=None,
+                 maxRss=None, maxTests=None):
+        self.command = shlex.split(command)
+        self.sendContents = sendContents
+        self.timeout = timeout
+        self.maxRss = maxRss
+        self.maxTests = maxTests
+        self.process = None
+        self.buffer = ''
+        self.testsSinceStart = 0
+        self.restarts = 0
+
+    def start(self):
+        self.process = subprocess.Popen(self.command, stdin=subprocess.PIPE,
+                                        stdout=subprocess.PIPE,
+                                        close_fds=True)
+        self.buffer = ''
+        self.testsSinceStart = 0
+
+    def stop(self):
+        if self.process is None:
+            return
+        try:
+            self.process.stdin.close()
+        except IOError:
+            pass
+        # give it a moment to exit on its own before killing it
+        for i in xrange(10):
+            if self.process.poll() is not None:
+                break
+            time.sleep(0.05)
+        if self.process.poll() is None:
+            os.kill(self.process.pid, signal.SIGKILL)
+            self.process.wait()
+        self.process.stdout.close()
+        self.process = None
+
+    def restart(self):
+        self.stop()
+        self.restarts += 1
+        self.start()
+
+    def readLine(self):
+        """Read one line from the oracle without blocking past the timeout."""
+        deadline = None
+        if self.timeout is not None:
+            deadline = time.time() + self.timeout
+        fd = self.process.stdout.fileno()
+        while '\n' not in self.buffer:
+            wait = None
+            if deadline is not None:
+                wait = deadline - time.time()
+                if wait <= 0:
+                    raise OracleError('timed out')
+            ready = select.select([fd], [], [], wait)[0]
+            if not ready:
+                raise OracleError('timed out')
+            data = os.read(fd, 4096)
+            if not data:
+                raise OracleError('oracle exited')
+            self.buffer += data
+        line, self.buffer = self.buffer.split('\n', 1)
+        return line.strip()
+
+    def ask(self, fileName):
+        if self.sendContents:
+            f = open(fileName, 'rb')
+            contents = f.read()
+            f.close()
+            request = "DATA %d\n%s" % (len(contents), contents)
+        else:
+            request = "TEST %s\n" % os.path.abspath(fileName)
+        try:
+            self.process.stdin.write(request)
+            self.process.stdin.flush()
+        except IOError:
+            raise OracleError('oracle exited')
+        answer = self.readLine()
+        if answer not in OUTCOMES:
+            raise OracleError('unexpected answer %r' % answer)
+        return answer
+
+    def test(self, fileName):
+        if self.process is None:
+            self.start()
+        for attempt in xrange(2):
+            try:
+                answer = self.ask(fileName)
+                break
+            except OracleError:
+                self.restart()
+        else:
+            return 'UNRESOLVED'
+
+        self.testsSinceStart += 1
+        if self.maxTests is not None and self.testsSinceStart >= self.maxTests:
+            self.restart()
+        elif self.maxRss is not None:
+            rss = residentSetSize(self.process.pid)
+            if rss is not None and rss > self.maxRss:
+                self.restart()
+        return answer
@@ -0,0 +1,84 @@
+#!/s/python-2.6.2/bin/python
+# -*- python -*-
+
+import math
+
+# prior used for buckets that haven't been tested yet: one FAIL in two tests
+priorFails = 1.0
+priorTests = 2.0
+maxDepthBucket = 8
+
+
+class AdaptiveOrdering(object):
+    """Online ordering of removal candidates.
+
+    Candidates are bucketed by node kind, nesting depth and (log2 of the)
+    source range size. For every bucket we keep how many tests came back
+    FAIL, i.e. how many removals stuck, and how long the compiler took. A
+    candidate is scored by the bytes it is expected to remove per compiler
+    second: P(FAIL | bucket) * range size / mean test time of the bucket.
+    """
+
+    def __init__(self, features, sizes=None):
+        # symbol -> (kind, depth, size)
+        self.features = features
+        # symbol -> bytes a removal is expected to take out, if not the
+        # node's own source range
+        self.sizes = sizes
+        # bucket -> [fails, tests, seconds]
+        self.outcomes = {}
+        self.totalTests = 0
+        self.totalSeconds = 0.0
+
+    def bucket(self, symbol):
+        kind, depth, size = self.features[symbol]
+        return (kind, min(depth, maxDepthBucket), int(math.log(size + 1, 2)))
+
+    def meanTestTime(self):
+        if self.totalTests == 0:
+            return 1.0
+        return self.totalSeconds / self.totalTests
+
+    def expectedRate(self, symbol):
+        if symbol not in self.features:
+            return 0.0
+        fails, tests, seconds = self.outcomes.get(self.bucket(symbol),
+                                                  [0, 0, 0.0])
+        pFail = (fails + priorFails) / (tests + priorTests)
+        meanSeconds = (seconds + self.meanTestTime()) / (tests + 1)
+        size = self.features[symbol][2]
+        if self.sizes is not None:
+            size = self.sizes.get(symbol, size)
+        return pFail * size / max(meanSeconds, 1e-6)
+
+    def choose(self, candidates):
+        best = None
+        bestRate = -1.0
+        for symbol in candidates:
+            rate = self.expectedRate(symbol)
+            if rate > bestRate:
+                best, bestRate = symbol, rate
+        return best
+
+    def record(self, symbol, result, seconds):
+        self.totalTests += 1
+        self.totalSeconds += seconds
+        if symbol not in self.features:
+            return
+        entry = self.outcomes.setdefault(self.bucket(symbol), [0, 0, 0.0])
+        if result == 'FAIL':
+            entry[0] += 1
+        entry[1] += 1
+        entry[2] += seconds
+
+
+def loadFeatures(featureTerms, getValueFromAtom):
+    """Turn the features(X, Kind, Depth, Size) terms returned by
+    allNodeFeatures/1 into a dictionary.
+    """
+    features = {}
+    for term in featureTerms:
+        symbol, kind, depth, size = term.args
+        features[getValueFromAtom(symbol)] = (getValueFromAtom(kind),
+                                              depth, size)
+    return features
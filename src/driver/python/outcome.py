@@ -0,0 +1,245 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""How a compiler run is judged, shared by the driver and the services that
+run tests on its behalf.
+
+    PASS        the compiler accepted the file without warnings
+    FAIL        the compiler crashed with an internal compiler error, i.e. the
+                failure we are reducing is still there
+    UNRESOLVED  anything else
+    RESOURCE    the run hit one of the caps of runCompilerWithUsage; the
+                driver treats it like UNRESOLVED but counts it apart
+"""
+
+import commands
+import os
+import re
+import resource
+import signal
+import subprocess
+
+OUTCOMES = ('PASS', 'FAIL', 'UNRESOLVED', 'RESOURCE')
+
+
+def classifyOutput(status, output):
+    if status == 0 and output.find("warning") <0:
+        return 'PASS'
+    elif output.find("warning") >=0:
+        return 'UNRESOLVED'
+    elif output.find("internal compiler error") >= 0:
+        return 'FAIL'
+    return 'UNRESOLVED'
+
+
+def runCompilerWithOutput(commandName, fileName):
+    # Invoke GCC
+    return commands.getstatusoutput("%s %s 2>&1" % (commandName, fileName))
+
+
+def runCompiler(commandName, fileName):
+    (status, output) = runCompilerWithOutput(commandName, fileName)
+
+    # print output
+    # print "Exit code", status
+    return classifyOutput(status, output)
+
+
+class ResourceLimits(object):
+    """Caps for one compiler run, None for no cap: the address space and the
+    output (files written, and what it prints) in bytes, CPU time in seconds.
+    The rlimits apply to every process of the run on its own, so a runaway
+    cc1 is stopped without the gcc driver around it counting.
+    """
+    def __init__(self, addressSpace=None, cpuSeconds=None, outputBytes=None):
+        self.addressSpace = addressSpace
+        self.cpuSeconds = cpuSeconds
+        self.outputBytes = outputBytes
+
+    def any(self):
+        return (self.addressSpace is not None or self.cpuSeconds is not None
+                or self.outputBytes is not None)
+
+    def apply(self):
+        """Runs in the child between fork and exec."""
+        # a process group of its own, so the whole run can be killed
+        os.setpgrp()
+        if self.addressSpace is not None:
+            resource.setrlimit(resource.RLIMIT_AS,
+                               (self.addressSpace, self.addressSpace))
+        if self.cpuSeconds is not None:
+            # SIGXCPU at the limit, SIGKILL a second later
+            resource.setrlimit(resource.RLIMIT_CPU,
+                               (self.cpuSeconds, self.cpuSeconds + 1))
+        if self.outputBytes is not None:
+            resource.setrlimit(resource.RLIMIT_FSIZE,
+                               (self.outputBytes, self.outputBytes))
+
+    def applyToTool(self):
+        """Runs in a tool that runs the tests itself (DDPhase2, TokenDD)
+        between fork and exec. The memory and output caps are inherited by
+        each test and hold per process; a CPU cap would be charged to the
+        tool, which outlives its tests, so it is left out.
+        """
+        if self.addressSpace is not None:
+            resource.setrlimit(resource.RLIMIT_AS,
+                               (self.addressSpace, self.addressSpace))
+        if self.outputBytes is not None:
+            resource.setrlimit(resource.RLIMIT_FSIZE,
+                               (self.outputBytes, self.outputBytes))
+
+
+def resourceLimits(memoryMB, cpuSeconds, outputMB):
+    """The limits of the --test* options of the driver and the daemon."""
+    limits = ResourceLimits(cpuSeconds=cpuSeconds)
+    if memoryMB is not None:
+        limits.addressSpace = memoryMB * 1024 * 1024
+    if outputMB is not None:
+        limits.outputBytes = outputMB * 1024 * 1024
+    return limits
+
+
+# what compilers say when an rlimit stops them, or stops the cc1 they ran
+# (which the gcc driver reports as an internal compiler error)
+resourcePatterns = [re.compile(pattern) for pattern in
+                    ("virtual memory exhausted", "out of memory",
+                     "Cannot allocate memory", "std::bad_alloc",
+                     "failed to map segment",
+                     "CPU time limit exceeded", "File size limit exceeded")]
+resourceSignals = (signal.SIGXCPU, signal.SIGXFSZ, signal.SIGKILL)
+
+
+def hitLimit(status, output):
+    """Whether a run was stopped by one of its rlimits. The CPU time of the
+    run sums all its processes, each of which may stay under RLIMIT_CPU, so
+    a breach is only what the kernel or the compiler says it is.
+    """
+    if os.WIFSIGNALED(status) and os.WTERMSIG(status) in resourceSignals:
+        return True
+    # the shell running the command reports a signal as 128 + the signal
+    if os.WIFEXITED(status) and os.WEXITSTATUS(status) - 128 in resourceSignals:
+        return True
+    for pattern in resourcePatterns:
+        if pattern.search(output):
+            return True
+    return False
+
+
+def runCompilerWithUsage(commandName, fileName, limits):
+    """Runs the compiler under LIMITS and returns (outcome, peak RSS in KB,
+    CPU seconds); the RSS and CPU time cover the processes it started.
+    Output past limits.outputBytes kills the run.
+    """
+    process = subprocess.Popen("%s %s 2>&1" % (commandName, fileName),
+                               shell=True, stdout=subprocess.PIPE,
+                               close_fds=True, preexec_fn=limits.apply)
+    chunks = []
+    size = 0
+    truncated = False
+    while True:
+        chunk = os.read(process.stdout.fileno(), 65536)
+        if not chunk:
+            break
+        chunks.append(chunk)
+        size += len(chunk)
+        if limits.outputBytes is not None and size > limits.outputBytes:
+            truncated = True
+            try:
+                os.killpg(process.pid, signal.SIGKILL)
+            except OSError:
+                pass
+            break
+    process.stdout.close()
+    pid, status, usage = os.wait4(process.pid, 0)
+    process.returncode = status
+
+    output = ''.join(chunks)
+    cpuSeconds = usage.ru_utime + usage.ru_stime
+    if limits.any() and (truncated or
+                         hitLimit(status, output)):
+        outcome = 'RESOURCE'
+    else:
+        outcome = classifyOutput(status, output)
+    return outcome, usage.ru_maxrss, cpuSeconds
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(int(fraction * len(ordered)), len(ordered) - 1)]
+
+
+class TestUsage(object):
+    """Peak RSS and CPU time of the compiler runs of a reduction, to size
+    the number of jobs by memory and not only by cores.
+    """
+    def __init__(self):
+        self.rss = []
+        self.cpu = []
+        self.resource = 0
+
+    def record(self, outcome, rss, cpuSeconds):
+        self.rss.append(rss)
+        self.cpu.append(cpuSeconds)
+        if outcome == 'RESOURCE':
+            self.resource += 1
+
+    def merge(self, other):
+        self.rss.extend(other.rss)
+        self.cpu.extend(other.cpu)
+        self.resource += other.resource
+
+    def report(self):
+        if not self.rss:
+            return ["TEST USAGE: NO TESTS MEASURED"]
+        lines = ["TEST RSS: P50 %d MB, P90 %d MB, MAX %d MB" %
+                 tuple([value / 1024 for value in
+                        (percentile(self.rss, 0.5), percentile(self.rss, 0.9),
+                         max(self.rss))]),
+                 "TEST CPU: MEAN %.2fs, P90 %.2fs, MAX %.2fs" %
+                 (sum(self.cpu) / len(self.cpu), percentile(self.cpu, 0.9),
+                  max(self.cpu)),
+                 "RESOURCE TESTS: %d" % self.resource]
+        try:
+            physical = os.sysconf('SC_PAGE_SIZE') * \
+                os.sysconf('SC_PHYS_PAGES') / 1024
+        except (ValueError, OSError):
+            physical = None
+        if physical is not None:
+            lines.append("JOBS BY MEMORY: %d" %
+                         max(physical / max(max(self.rss), 1), 1))
+        return lines
+
+
+def crashSignature(output):
+    """What the compiler says after "internal compiler error:", e.g. "in
+    fold_convert, at fold-const.c:1800". It names the place in the compiler
+    that failed and not the input, so it stays the same while the input is
+    reduced. None if the compiler didn't crash.
+    """
+    marker = "internal compiler error"
+    for line in output.splitlines():
+        position = line.find(marker)
+        if position >= 0:
+            return line[position + len(marker):].lstrip(': ').strip()
+    return None
+
+
+# where compilers say which function they were compiling when they crashed:
+# gcc's "In function `foo':" (or 'int foo(int)' for C++, or in UTF-8 quotes),
+# clang's stack dump lines "... parsing function body 'foo'" and "... on
+# function '@foo'"
+crashFunctionPatterns = [re.compile("In function (?:[`']|\xe2\x80\x98)([^'\xe2]+)"),
+                         re.compile(r"function body '([^']+)'"),
+                         re.compile(r"on function '@?([^']+)'")]
+
+
+def crashFunction(output):
+    """The unqualified name of the function the compiler crashed in, None if
+    it didn't say.
+    """
+    for pattern in crashFunctionPatterns:
+        match = pattern.search(output)
+        if match is not None:
+            name = match.group(1).split('(')[0].split()[-1]
+            return name.split('::')[-1]
+    return None
@@ -0,0 +1,181 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""All-pairs reachability over the implicitDependsOn graph.
+
+The graph is condensed into strongly connected components and the transitive
+closure of every component is kept as a packed bitset (a python long, one bit
+per node) in both directions. The allDependsOn/allDependingOn counts used by
+the heuristic comparators in inferenceRules.pl then become a popcount of the
+closure ANDed with the mask of currently removable nodes, which is a handful
+of word-parallel operations per candidate instead of a graph walk.
+"""
+
+
+def popcount(mask):
+    return bin(mask).count('1')
+
+
+def stronglyConnectedComponents(successors):
+    """Iterative Tarjan. Components come out in reverse topological order,
+    i.e. every component is emitted after all components reachable from it.
+    """
+    n = len(successors)
+    index = [None] * n
+    lowlink = [0] * n
+    onStack = [False] * n
+    stack = []
+    components = []
+    counter = 0
+
+    for root in xrange(n):
+        if index[root] is not None:
+            continue
+        work = [(root, 0)]
+        while work:
+            v, i = work[-1]
+            if i == 0:
+                index[v] = lowlink[v] = counter
+                counter += 1
+                stack.append(v)
+                onStack[v] = True
+
+            descended = False
+            for j in xrange(i, len(successors[v])):
+                w = successors[v][j]
+                if index[w] is None:
+                    work[-1] = (v, j + 1)
+                    work.append((w, 0))
+                    descended = True
+                    break
+                elif onStack[w]:
+                    lowlink[v] = min(lowlink[v], index[w])
+            if descended:
+                continue
+
+            work.pop()
+            if work:
+                u = work[-1][0]
+                lowlink[u] = min(lowlink[u], lowlink[v])
+
+            if lowlink[v] == index[v]:
+                component = []
+                while True:
+                    w = stack.pop()
+                    onStack[w] = False
+                    component.append(w)
+                    if w == v:
+                        break
+                components.append(component)
+
+    return components
+
+
+class ReachabilityIndex(object):
+    def __init__(self, dependencies):
+        """DEPENDENCIES is a list of (X, Y) pairs meaning X depends on Y."""
+        self.symbols = []
+        self.position = {}
+        for x, y in dependencies:
+            self.add(x)
+            self.add(y)
+
+        n = len(self.symbols)
+        successors = [[] for i in xrange(n)]
+        predecessors = [[] for i in xrange(n)]
+        for x, y in dependencies:
+            successors[self.position[x]].append(self.position[y])
+            predecessors[self.position[y]].append(self.position[x])
+
+        components = stronglyConnectedComponents(successors)
+        componentOf = [0] * n
+        for c, members in enumerate(components):
+            for v in members:
+                componentOf[v] = c
+
+        # closure of each component, itself included
+        dependsOn = [0] * len(components)
+        for c, members in enumerate(components):
+            mask = 0
+            for v in members:
+                mask |= 1 << v
+                for w in successors[v]:
+                    if componentOf[w] != c:
+                        mask |= dependsOn[componentOf[w]]
+            dependsOn[c] = mask
+
+        dependingOn = [0] * len(components)
+        for c in xrange(len(components) - 1, -1, -1):
+            mask = 0
+            for v in components[c]:
+                mask |= 1 << v
+                for w in predecessors[v]:
+                    if componentOf[w] != c:
+                        mask |= dependingOn[componentOf[w]]
+            dependingOn[c] = mask
+
+        self.dependsOn = [dependsOn[componentOf[v]] & ~(1 << v)
+                          for v in xrange(n)]
+        self.dependingOn = [dependingOn[componentOf[v]] & ~(1 << v)
+                            for v in xrange(n)]
+
+    def add(self, symbol):
+        if symbol not in self.position:
+            self.position[symbol] = len(self.symbols)
+            self.symbols.append(symbol)
+
+    def maskOf(self, symbols):
+        mask = 0
+        for symbol in symbols:
+            if symbol in self.position:
+                mask |= 1 << self.position[symbol]
+        return mask
+
+    def symbolsOf(self, mask):
+        return [self.symbols[v] for v in xrange(len(self.symbols))
+                if mask & (1 << v)]
+
+    def allDependsOnCount(self, symbol, liveMask):
+        if symbol not in self.position:
+            return 0
+        return popcount(self.dependsOn[self.position[symbol]] & liveMask)
+
+    def allDependingOnCount(self, symbol, liveMask):
+        if symbol not in self.position:
+            return 0
+        return popcount(self.dependingOn[self.position[symbol]] & liveMask)
+
+    def score(self, heuristic, symbol, liveMask):
+        """Sort key matching the comparator behind HEURISTIC; larger wins."""
+        dependsOn = self.allDependsOnCount(symbol, liveMask)
+        dependingOn = self.allDependingOnCount(symbol, liveMask)
+        if heuristic == 'TOP':
+            # sortAllDependingOnDescAllDependsOnDesc
+            return (dependingOn, dependsOn)
+        elif heuristic == 'BOTTOM':
+            # sortAllDependsOnDescAllDependingOnDesc
+            return (dependsOn, dependingOn)
+        elif heuristic == 'AVERAGE':
+            # sortAllAverageDesc
+            return (dependingOn + dependsOn,)
+        elif heuristic == 'HARMONIC':
+            # sortAllHarmonicDesc
+            if dependingOn + dependsOn == 0:
+                return (0.0,)
+            return (float(dependingOn * dependsOn) / (dependingOn + dependsOn),)
+        raise ValueError("no bitset scoring for heuristic %s" % heuristic)
+
+    def topScoring(self, heuristic, candidates, liveMask):
+        """Same choice findMin makes with the corresponding comparator. TOP and
+        BOTTOM break ties towards the larger symbol, the others towards the
+        smaller one.
+        """
+        preferLarger = heuristic in ('TOP', 'BOTTOM')
+        best = None
+        bestScore = None
+        for symbol in candidates:
+            score = self.score(heuristic, symbol, liveMask)
+            if (best is None or score > bestScore or
+                (score == bestScore and (symbol > best) == preferLarger)):
+                best, bestScore = symbol, score
+        return best
@@ -0,0 +1,428 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Reduction daemon.
+
+Runs many reductions at once on one machine. Every job is an ordinary
+driver.py process with its own prolog fact base, started in a directory of
+its own; what the jobs share is one pool of compiler runs, sized to the
+number of cores. The drivers hand their tests to the pool over the daemon's
+Unix socket (driver.py --testServer) and the pool serves the jobs fairly:
+a free worker always picks a test from the job that currently has the
+fewest tests running, and among those the one that has been served least.
+With --testMemoryMB, --testCpuSeconds or --testOutputMB every compiler run
+is capped (see outcome.py) and STATUS reports what the runs used, so one
+runaway candidate can't push the machine into swap.
+
+The protocol is one command per line:
+
+    SUBMIT <input file> [driver options]   ->  JOB <id>
+    TEST <id> <file> <test command>        ->  PASS | FAIL | UNRESOLVED |
+                                               RESOURCE
+    STATUS [<id>]                          ->  status lines, then END
+
+    sddd.py serve [--socket PATH] [--workers N] [--maxJobs N]
+    sddd.py submit [--socket PATH] FILE [-- driver options]
+    sddd.py status [--socket PATH] [ID]
+"""
+
+from __future__ import with_statement
+
+import multiprocessing
+import optparse
+import os
+import os.path
+import socket
+import SocketServer
+import subprocess
+import sys
+import threading
+import time
+
+from collections import deque
+from shutil import copy
+
+from outcome import runCompiler, runCompilerWithUsage, resourceLimits
+from outcome import TestUsage
+
+driverDirectory = os.path.dirname(os.path.abspath(__file__))
+defaultSocketPath = 'sddd.sock'
+# files of the constraint solver the driver consults from its working directory
+solverFiles = ['load.pl', 'inferenceRules.pl', 'utils.pl']
+# tests finished within this many seconds count towards the current rate
+rateWindow = 60.0
+
+
+class TestRequest(object):
+    def __init__(self, jobId, fileName, commandName):
+        self.jobId = jobId
+        self.fileName = fileName
+        self.commandName = commandName
+        self.outcome = None
+        self.done = threading.Event()
+
+
+class FairShareScheduler(object):
+    """Pending tests, queued per job."""
+
+    def __init__(self):
+        self.condition = threading.Condition()
+        self.pending = {}
+        self.running = {}
+        self.served = {}
+
+    def submit(self, request):
+        self.condition.acquire()
+        try:
+            self.pending.setdefault(request.jobId, deque()).append(request)
+            self.condition.notify()
+        finally:
+            self.condition.release()
+
+    def next(self):
+        self.condition.acquire()
+        try:
+            while not [j for j in self.pending if self.pending[j]]:
+                self.condition.wait()
+            waiting = [j for j in self.pending if self.pending[j]]
+            jobId = min(waiting, key=lambda j: (self.running.get(j, 0),
+                                                self.served.get(j, 0)))
+            self.running[jobId] = self.running.get(jobId, 0) + 1
+            return self.pending[jobId].popleft()
+        finally:
+            self.condition.release()
+
+    def finished(self, jobId):
+        self.condition.acquire()
+        try:
+            self.running[jobId] = self.running.get(jobId, 1) - 1
+            self.served[jobId] = self.served.get(jobId, 0) + 1
+        finally:
+            self.condition.release()
+
+    def depth(self, jobId=None):
+        self.condition.acquire()
+        try:
+            if jobId is not None:
+                return len(self.pending.get(jobId, ()))
+            return sum([len(queue) for queue in self.pending.values()])
+        finally:
+            self.condition.release()
+
+    def forget(self, jobId):
+        """Drop the bookkeeping of a job whose driver has exited."""
+        self.condition.acquire()
+        try:
+            for table in (self.pending, self.running, self.served):
+                table.pop(jobId, None)
+        finally:
+            self.condition.release()
+
+
+class Throughput(object):
+    """Finished tests in total and over the last RATEWINDOW seconds."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.total = 0
+        self.recent = deque()
+        self.started = time.time()
+
+    def record(self):
+        with self.lock:
+            self.total += 1
+            self.recent.append(time.time())
+
+    def rate(self):
+        with self.lock:
+            now = time.time()
+            while self.recent and self.recent[0] < now - rateWindow:
+                self.recent.popleft()
+            return len(self.recent) / min(rateWindow,
+                                          max(now - self.started, 1.0))
+
+
+class Job(object):
+    def __init__(self, jobId, inputFileName, driverOptions, directory):
+        self.jobId = jobId
+        self.inputFileName = inputFileName
+        self.driverOptions = driverOptions
+        self.directory = directory
+        self.state = 'queued'
+        self.process = None
+        self.returnCode = None
+        self.submitted = time.time()
+        self.started = None
+        self.finished = None
+        self.throughput = Throughput()
+
+
+class ReductionDaemon(SocketServer.ThreadingMixIn,
+                      SocketServer.UnixStreamServer):
+    daemon_threads = True
+
+    def __init__(self, socketPath, workers, maxJobs, workDirectory,
+                 solverDirectory, driverArguments, limits=None):
+        if os.path.exists(socketPath):
+            os.remove(socketPath)
+        SocketServer.UnixStreamServer.__init__(self, socketPath,
+                                               ReductionRequestHandler)
+        self.socketPath = os.path.abspath(socketPath)
+        self.workers = workers
+        self.maxJobs = maxJobs
+        self.workDirectory = os.path.abspath(workDirectory)
+        self.solverDirectory = os.path.abspath(solverDirectory)
+        self.driverArguments = driverArguments
+        self.limits = limits
+        self.usage = TestUsage()
+        self.usageLock = threading.Lock()
+        self.scheduler = FairShareScheduler()
+        self.throughput = Throughput()
+        self.jobs = {}
+        self.jobOrder = []
+        self.jobsLock = threading.Lock()
+        self.nextJobId = 0
+
+        if not os.path.isdir(self.workDirectory):
+            os.makedirs(self.workDirectory)
+        for i in xrange(workers):
+            self.startThread(self.runTests)
+        self.startThread(self.runJobs)
+
+    def startThread(self, target):
+        thread = threading.Thread(target=target)
+        thread.setDaemon(True)
+        thread.start()
+
+    def runTests(self):
+        while True:
+            request = self.scheduler.next()
+            try:
+                if self.limits is not None:
+                    request.outcome, rss, cpuSeconds = \
+                        runCompilerWithUsage(request.commandName,
+                                             request.fileName, self.limits)
+                    with self.usageLock:
+                        self.usage.record(request.outcome, rss, cpuSeconds)
+                else:
+                    request.outcome = runCompiler(request.commandName,
+                                                  request.fileName)
+            except Exception:
+                request.outcome = 'UNRESOLVED'
+            self.scheduler.finished(request.jobId)
+            self.throughput.record()
+            job = self.jobs.get(request.jobId)
+            if job is not None:
+                job.throughput.record()
+            request.done.set()
+
+    def runJobs(self):
+        """Start queued jobs while there is room and reap finished ones."""
+        while True:
+            with self.jobsLock:
+                active = 0
+                for jobId in self.jobOrder:
+                    job = self.jobs[jobId]
+                    if job.state == 'running':
+                        if job.process.poll() is None:
+                            active += 1
+                            continue
+                        job.returnCode = job.process.returncode
+                        job.finished = time.time()
+                        job.state = 'done'
+                        if job.returnCode != 0:
+                            job.state = 'failed'
+                        self.scheduler.forget(jobId)
+                for jobId in self.jobOrder:
+                    job = self.jobs[jobId]
+                    if job.state == 'queued' and active < self.maxJobs:
+                        self.startJob(job)
+                        active += 1
+            time.sleep(0.5)
+
+    def submit(self, inputFileName, driverOptions):
+        with self.jobsLock:
+            jobId = str(self.nextJobId)
+            self.nextJobId += 1
+            directory = os.path.join(self.workDirectory, "job%s" % jobId)
+            self.jobs[jobId] = Job(jobId, os.path.abspath(inputFileName),
+                                   driverOptions, directory)
+            self.jobOrder.append(jobId)
+        return jobId
+
+    def startJob(self, job):
+        """Every job gets a directory of its own: the driver and the
+        constraint generator work on fixed file names in the current
+        directory (out.txt, alpha.c, beta.c, ...).
+        """
+        os.makedirs(job.directory)
+        for fileName in solverFiles:
+            source = os.path.join(self.solverDirectory, fileName)
+            if os.path.exists(source):
+                os.symlink(source, os.path.join(job.directory, fileName))
+        copy(job.inputFileName, job.directory)
+
+        command = [sys.executable, os.path.join(driverDirectory, 'driver.py'),
+                   '--testServer', self.socketPath, '--jobId', job.jobId]
+        command += self.driverArguments + job.driverOptions
+        command.append(os.path.basename(job.inputFileName))
+        log = open(os.path.join(job.directory, 'driver.log'), 'w')
+        job.process = subprocess.Popen(command, cwd=job.directory,
+                                       stdout=log, stderr=subprocess.STDOUT)
+        log.close()
+        job.started = time.time()
+        job.state = 'running'
+
+    def status(self, jobId=None):
+        lines = []
+        with self.jobsLock:
+            jobIds = self.jobOrder
+            if jobId is not None:
+                jobIds = [j for j in self.jobOrder if j == jobId]
+            running = len([j for j in self.jobOrder
+                           if self.jobs[j].state == 'running'])
+            queued = len([j for j in self.jobOrder
+                          if self.jobs[j].state == 'queued'])
+            if jobId is None:
+                lines.append("DAEMON workers=%d running=%d queued=%d "
+                             "tests=%d pending=%d rate=%.2f/s" %
+                             (self.workers, running, queued,
+                              self.throughput.total, self.scheduler.depth(),
+                              self.throughput.rate()))
+                if self.limits is not None:
+                    with self.usageLock:
+                        lines.extend(self.usage.report())
+            for j in jobIds:
+                job = self.jobs[j]
+                elapsed = 0.0
+                if job.started is not None:
+                    elapsed = (job.finished or time.time()) - job.started
+                lines.append("JOB %s %s tests=%d pending=%d rate=%.2f/s "
+                             "elapsed=%.1fs input=%s" %
+                             (job.jobId, job.state, job.throughput.total,
+                              self.scheduler.depth(j),
+                              job.throughput.rate(), elapsed,
+                              job.inputFileName))
+        return lines
+
+
+class ReductionRequestHandler(SocketServer.StreamRequestHandler):
+    def handle(self):
+        daemon = self.server
+        for line in iter(self.rfile.readline, ''):
+            fields = line.split()
+            if not fields:
+                continue
+            command = fields[0]
+            if command == 'TEST' and len(fields) >= 4:
+                request = TestRequest(fields[1], fields[2],
+                                      ' '.join(fields[3:]))
+                daemon.scheduler.submit(request)
+                request.done.wait()
+                self.wfile.write("%s\n" % request.outcome)
+            elif command == 'SUBMIT' and len(fields) >= 2:
+                if not os.path.isfile(fields[1]):
+                    self.wfile.write("ERROR no such file %s\n" % fields[1])
+                    continue
+                jobId = daemon.submit(fields[1], fields[2:])
+                self.wfile.write("JOB %s\n" % jobId)
+            elif command == 'STATUS':
+                jobId = None
+                if len(fields) > 1:
+                    jobId = fields[1]
+                for statusLine in daemon.status(jobId):
+                    self.wfile.write("%s\n" % statusLine)
+                self.wfile.write("END\n")
+            else:
+                self.wfile.write("ERROR unknown command %s\n" % command)
+            self.wfile.flush()
+
+
+def request(socketPath, line):
+    """Send one command to the daemon and return its reply lines."""
+    connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    connection.connect(socketPath)
+    stream = connection.makefile('r+', 0)
+    stream.write("%s\n" % line)
+    stream.flush()
+    reply = []
+    for replyLine in iter(stream.readline, ''):
+        replyLine = replyLine.rstrip('\n')
+        reply.append(replyLine)
+        if not line.startswith('STATUS') or replyLine == 'END':
+            break
+    connection.close()
+    return reply
+
+
+def main(argv=None):
+    if argv is None:
+        argv = sys.argv
+
+    parser = optparse.OptionParser(
+        usage='%prog serve|submit|status [options] [FILE|ID] [-- driver options]')
+    parser.add_option('-s', '--socket', action='store',
+                      default=defaultSocketPath,
+                      help = 'Unix socket the daemon listens on')
+    parser.add_option('-w', '--workers', action='store', type='int',
+                      default=multiprocessing.cpu_count(),
+                      help = 'compiler runs in flight at once')
+    parser.add_option('-m', '--maxJobs', action='store', type='int',
+                      default=None,
+                      help = 'driver processes alive at once (default: 2 * workers)')
+    parser.add_option('-d', '--workDir', action='store', default='sddd-jobs',
+                      help = 'directory the job directories are created in')
+    parser.add_option('--solverDir', action='store',
+                      default=os.path.join(driverDirectory, '..', '..',
+                                           'constraintSolver', 'swipl'),
+                      help = 'where load.pl and inferenceRules.pl live')
+    parser.add_option('--constraintGenerator', action='store', default=None,
+                      help = 'GenerateConstraints binary handed to the drivers')
+    parser.add_option('--testMemoryMB', type='int', default=None,
+                      help = 'cap the address space of every compiler process at this many MB')
+    parser.add_option('--testCpuSeconds', type='int', default=None,
+                      help = 'cap the CPU time of every compiler process')
+    parser.add_option('--testOutputMB', type='int', default=None,
+                      help = 'cap what a compiler run writes and prints at this many MB')
+
+    options, args = parser.parse_args(argv[1:])
+    if len(args) < 1:
+        parser.error('missing command')
+
+    if args[0] == 'serve':
+        maxJobs = options.maxJobs
+        if maxJobs is None:
+            maxJobs = 2 * options.workers
+        driverArguments = []
+        if options.constraintGenerator is not None:
+            driverArguments = ['--constraintGenerator',
+                               os.path.abspath(options.constraintGenerator)]
+        limits = resourceLimits(options.testMemoryMB, options.testCpuSeconds,
+                                options.testOutputMB)
+        if not limits.any():
+            limits = None
+        daemon = ReductionDaemon(options.socket, options.workers, maxJobs,
+                                 options.workDir, options.solverDir,
+                                 driverArguments, limits)
+        try:
+            daemon.serve_forever()
+        finally:
+            os.remove(options.socket)
+    elif args[0] == 'submit':
+        if len(args) < 2:
+            parser.error('submit needs an input file')
+        for replyLine in request(options.socket, "SUBMIT %s %s" %
+                                 (os.path.abspath(args[1]),
+                                  ' '.join(args[2:]))):
+            print replyLine
+    elif args[0] == 'status':
+        for replyLine in request(options.socket, "STATUS %s" %
+                                 ' '.join(args[1:])):
+            if replyLine != 'END':
+                print replyLine
+    else:
+        parser.error('unknown command "%s"' % args[0])
+
+###############################################################################
+if __name__ == '__main__':
+    sys.exit(main())
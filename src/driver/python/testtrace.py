@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+# -*- python -*-
+
+"""Reduction traces: the tests a run made and what the compiler said.
+
+The first line identifies the input (its sha1 and name); every following line
+is one test, in the order the driver ran them:
+
+    <outcome> <digest of the tested file> sym1 sym2 ...
+
+where the symbols are the nodes the test removed. A trace recorded from a real
+run can be replayed as the oracle: the driver then never calls the compiler,
+which leaves the solver, the heuristics and the file materializer to be
+profiled on their own. Replay checks every test against the recording and
+counts the ones where the driver removed other nodes or produced a different
+file than the recorded run did.
+"""
+
+from journal import fileDigest
+
+
+class TraceRecorder(object):
+    def __init__(self, fileName, inputFileName):
+        self.handle = open(fileName, 'w')
+        self.handle.write("input %s %s\n" % (fileDigest(inputFileName),
+                                             inputFileName))
+
+    def record(self, candidates, fileName, outcome):
+        self.handle.write("%s %s %s\n" % (outcome, fileDigest(fileName),
+                                          ' '.join(candidates or [])))
+
+    def close(self):
+        self.handle.close()
+
+
+class TraceReplayer(object):
+    def __init__(self, fileName, inputFileName):
+        self.header, self.tests = readTrace(fileName)
+        if self.header is None or self.header[0] != fileDigest(inputFileName):
+            raise ValueError("%s was not recorded for %s" %
+                             (fileName, inputFileName))
+        # outcomes by removed nodes, for tests that come out of order
+        self.byCandidates = {}
+        for outcome, digest, candidates in self.tests:
+            self.byCandidates[frozenset(candidates)] = outcome
+        self.position = 0
+        self.diverged = 0
+        self.missing = 0
+        self.firstDivergence = None
+
+    def outcome(self, candidates, fileName):
+        candidates = candidates or []
+        if self.position < len(self.tests):
+            outcome, digest, recorded = self.tests[self.position]
+            self.position += 1
+            if recorded == candidates and digest == fileDigest(fileName):
+                return outcome
+        self.noteDivergence()
+        key = frozenset(candidates)
+        if key in self.byCandidates:
+            return self.byCandidates[key]
+        self.missing += 1
+        return 'UNRESOLVED'
+
+    def noteDivergence(self):
+        if self.firstDivergence is None:
+            self.firstDivergence = self.position
+        self.diverged += 1
+
+    def report(self):
+        print "TRACE: %d RECORDED, %d REPLAYED, %d DIVERGED, %d MISSING" % \
+            (len(self.tests), self.position, self.diverged, self.missing)
+        if self.firstDivergence is not None:
+            print "TRACE: FIRST DIVERGENCE AT TEST %d" % self.firstDivergence
+
+
+def readTrace(fileName):
+    """Returns ((digest, inputFileName), [(outcome, digest, [symbols])])."""
+    header = None
+    tests = []
+    with open(fileName) as f:
+        for line in f:
+            fields = line.split()
+            if not fields:
+                continue
+            if header is None:
+                if fields[0] != 'input' or len(fields) < 3:
+                    break
+                header = (fields[1], ' '.join(fields[2:]))
+                continue
+            tests.append((fields[0], fields[1], fields[2:]))
+    return header, tests
@@ -1,9 +1,13 @@
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
 #include <set>
+#include <vector>
 
 #include <clang/AST/ASTConsumer.h>
 #include <clang/AST/AST.h>
@@ -25,7 +29,7 @@ using namespace clang;
 
 namespace
 {
-  typedef llvm::raw_fd_ostream RawOS;
+  typedef llvm::raw_ostream RawOS;
   
   typedef std::string String;
   
@@ -45,13 +49,23 @@ namespace
   void printDependency(RawOS &os, String logVar, String dependency);
   
   void VisitInceptionPoint(RawOS &os, ASTContext &Context, Decl * D);
+  bool isEditable(SourceManager & SM, SourceLocation loc);
+  String lookupDeclSymbol(RawOS &os, SourceManager & SM, Decl * D);
   
   // Yay global vars
   DeclToSymMap declToSymbolMap;
   SymToDeclMap symbolToDeclMap;
   StmtToSymMap stmtToSymbolMap;
   SymToStmtMap symbolToStmtMap;
+  
+  // By default everything outside a system header gets constraints. With
+  // restrictToEditableFiles set only the main file and the files listed in
+  // editableFiles do; declarations elsewhere are reduced to external anchors.
+  bool restrictToEditableFiles = false;
+  std::set<String> editableFiles;
 
+  // Number of threads scanning statement source ranges; see DeferredRanges.
+  unsigned int rangeJobs = 1;
   
   inline void _debug(String s)
   {
@@ -67,6 +81,200 @@ namespace
     return oss.str();
   }
   
+  // Scanning the source text for the ranges of the statements in function
+  // bodies is where most of the time goes. With rangeJobs > 1 the walk over
+  // the AST stays as it is, but instead of scanning the ranges of a
+  // statement it leaves a job at the point in the output where they belong.
+  // Once the translation unit is done the locations the jobs need are looked
+  // up (the SourceManager is not thread-safe), the jobs are scanned by
+  // rangeJobs threads, each into its own string, and the output is put back
+  // together in the order of the walk, so out.txt is the same as with a
+  // single thread.
+  //
+  // Declarations are still scanned during the walk: their ranges depend on
+  // redeclarations (hasBody) that may only show up further down the file.
+  class DeferredRanges
+  {
+  public:
+    DeferredRanges(RawOS & stream)
+      :os(stream),
+       bufferStream(buffer),
+       nextJob(0)
+    {
+      pthread_mutex_init(&lock, NULL);
+    }
+    
+    ~DeferredRanges()
+    {
+      pthread_mutex_destroy(&lock);
+    }
+    
+    RawOS & output()
+    {
+      return bufferStream;
+    }
+    
+    // A statement can be given a new symbol later in the walk, so the jobs
+    // look symbols up as of the GUID_COUNT they were created at.
+    void bind(Stmt * S, const String & symbol)
+    {
+      bindings[S].push_back(std::make_pair(GUID_COUNT, symbol));
+    }
+    
+    void defer(Stmt * S)
+    {
+      bufferStream.flush();
+      
+      RangeJob job;
+      job.S = S;
+      job.stamp = GUID_COUNT;
+      job.offset = buffer.size();
+      jobs.push_back(job);
+    }
+    
+    void finish(SourceManager & SM, unsigned int threads)
+    {
+      bufferStream.flush();
+      
+      // the workers never touch the SourceManager
+      for (size_t i = 0; i < jobs.size(); ++i)
+      {
+        locations.add(SM, jobs[i].S);
+      }
+      
+      std::vector<pthread_t> workers;
+      for (unsigned int i = 1; i < threads; ++i)
+      {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, runWorker, this) != 0)
+        {
+          break;
+        }
+        workers.push_back(worker);
+      }
+      
+      // this thread takes its share too, and all of them if no thread
+      // could be started
+      work();
+      
+      for (size_t i = 0; i < workers.size(); ++i)
+      {
+        pthread_join(workers[i], NULL);
+      }
+      
+      size_t written = 0;
+      for (size_t i = 0; i < jobs.size(); ++i)
+      {
+        os.write(buffer.data() + written, jobs[i].offset - written);
+        os << jobs[i].text;
+        written = jobs[i].offset;
+      }
+      os.write(buffer.data() + written, buffer.size() - written);
+      os.flush();
+    }
+    
+  private:
+    struct RangeJob
+    {
+      Stmt * S;
+      unsigned int stamp;
+      size_t offset;
+      String text;
+    };
+    
+    typedef std::vector<std::pair<unsigned int, String> > Bindings;
+    
+    // The symbols as they were when a job was created.
+    class StampedLookup : public SymbolLookup
+    {
+    public:
+      StampedLookup(const std::map<Stmt *, Bindings> & stmtBindings,
+                    unsigned int jobStamp)
+        :bindings(stmtBindings),
+         stamp(jobStamp)
+      {
+      }
+      
+      String symbolFor(Decl * D) const
+      {
+        return "";
+      }
+      
+      String symbolFor(Stmt * S) const
+      {
+        std::map<Stmt *, Bindings>::const_iterator it = bindings.find(S);
+        if (it == bindings.end())
+        {
+          return "";
+        }
+        
+        for (Bindings::const_reverse_iterator b = it->second.rbegin();
+             b != it->second.rend();
+             ++b)
+        {
+          if (b->first <= stamp)
+          {
+            return b->second;
+          }
+        }
+        return "";
+      }
+      
+    private:
+      const std::map<Stmt *, Bindings> & bindings;
+      unsigned int stamp;
+    };
+    
+    static void * runWorker(void * self)
+    {
+      static_cast<DeferredRanges *>(self)->work();
+      return NULL;
+    }
+    
+    void work()
+    {
+      // jobs are handed out a block at a time to keep the lock cold
+      const size_t blockSize = 64;
+      
+      for (;;)
+      {
+        pthread_mutex_lock(&lock);
+        size_t begin = nextJob;
+        nextJob += blockSize;
+        pthread_mutex_unlock(&lock);
+        
+        if (begin >= jobs.size())
+        {
+          return;
+        }
+        
+        size_t end = std::min(begin + blockSize, jobs.size());
+        for (size_t i = begin; i < end; ++i)
+        {
+          StampedLookup symbols(bindings, jobs[i].stamp);
+          OffsetRanges oRanges = getRealSourceRange(jobs[i].S, locations,
+                                                    symbols);
+          
+          llvm::raw_string_ostream text(jobs[i].text);
+          printSourceRanges(text, oRanges);
+          text.flush();
+        }
+      }
+    }
+    
+    RawOS & os;
+    ResolvedLocations locations;
+    String buffer;
+    llvm::raw_string_ostream bufferStream;
+    std::vector<RangeJob> jobs;
+    std::map<Stmt *, Bindings> bindings;
+    pthread_mutex_t lock;
+    size_t nextJob;
+  };
+  
+  // Set when the statement ranges are scanned in parallel.
+  DeferredRanges * deferredRanges = NULL;
+  
   class DeclForTypeVisitor : public TypeVisitor<DeclForTypeVisitor, Decl*>
   {
   public:
@@ -124,8 +332,16 @@ namespace
       stmtToSymbolMap[S] = symbol; // Create a mapping from the Stmt to the Symbol
       symbolToStmtMap[symbol] = S; // Create a mapping from the Symbol to the Stmt
       
-      OffsetRanges oRanges = getRealSourceRange(*SM, S, stmtToSymbolMap);
-      printSourceRanges(os, oRanges);
+      if (deferredRanges != NULL)
+      {
+        deferredRanges->bind(S, symbol);
+        deferredRanges->defer(S);
+      }
+      else
+      {
+        OffsetRanges oRanges = getRealSourceRange(*SM, S, stmtToSymbolMap);
+        printSourceRanges(os, oRanges);
+      }
       os << "\n";
       os.flush();
       
@@ -300,7 +516,7 @@ namespace
       
       // Look up the symbol from the associated declaration
       // and add it to the stmt-level scope
-      stmtSymbols.insert(declToSymbolMap[E->getMemberDecl()]);
+      stmtSymbols.insert(lookupDeclSymbol(os, *SM, E->getMemberDecl()));
       
       _debug("OUT\tVisitMemberExpr");
     }
@@ -311,7 +527,7 @@ namespace
       
       // Look up the symbol from the associated declaration
       // and add it to the stmt-level scope
-      stmtSymbols.insert(declToSymbolMap[E->getDecl()]);
+      stmtSymbols.insert(lookupDeclSymbol(os, *SM, E->getDecl()));
       
       _debug("OUT\tVisitDeclRefExpr\n");
     }
@@ -322,7 +538,7 @@ namespace
       
       // Look up the symbol from the associated declaration
       // and add it to the stmt-level scope
-      stmtSymbols.insert(declToSymbolMap[E->getDecl()]);
+      stmtSymbols.insert(lookupDeclSymbol(os, *SM, E->getDecl()));
       
       _debug("OUT\tVisitBlockDeclRefExpr\n");
     }
@@ -406,10 +622,10 @@ namespace
       {
         Decl *D = *i;
         
-        // Don't generate constraints for decls that are not in the main
+        // Don't generate constraints for decls that are not in an editable
         // file, since we can't remove those anyway.
         SourceRange sr = D->getSourceRange();
-        if(isInMainFile(sr))
+        if(isEditable(*SM, sr.getBegin()))
         {
           if(declToSymbolMap.find(D) == declToSymbolMap.end())
           {
@@ -427,10 +643,10 @@ namespace
     {
       _debug("IN\tHandleTagDeclDefinition\n");
       
-      // Don't generate constraints for decls that are not in the main
+      // Don't generate constraints for decls that are not in an editable
       // file, since we can't remove those anyway.
       SourceRange sr = D->getSourceRange();
-      if(!isInMainFile(sr))
+      if(!isEditable(*SM, sr.getBegin()))
       {
         return;
       }
@@ -443,6 +659,14 @@ namespace
       os.flush();
       _debug("OUT\tHandleTagDeclDefinition\n");
     }
+    
+    virtual void HandleTranslationUnit(ASTContext & Context)
+    {
+      if (deferredRanges != NULL)
+      {
+        deferredRanges->finish(*SM, rangeJobs);
+      }
+    }
 
     void VisitTypedefDecl(TypedefDecl *D)
     {
@@ -639,10 +863,22 @@ namespace
       // then descend into body, creating dependencies from contained stmts to 
       // function containing them.
       
+      String body;
       if (D->hasBody())
       {
         ConstraintVisitor c(os, SM, astContext);
         c.Visit(D->getBody());
+        
+        // the body as a whole, so that it can be stubbed out, leaving a
+        // prototype behind
+        if (D->isThisDeclarationADefinition())
+        {
+          body = c.AddStmt(D->getBody());
+          RangeKindToGUIDMap bodyNames;
+          bodyNames[COMPOUNDSTMT] = body;
+          printSymbol(os, bodyNames);
+          os << "\n";
+        }
       }
       
       
@@ -654,6 +890,13 @@ namespace
       {
         os << "\nisMain(" << var << ").\n";
       }      
+      
+      // lets the driver find the function a crash is reported in
+      os << "\nhasName(" << var << ", '" << D->getNameAsString() << "').\n";
+      if (!body.empty())
+      {
+        os << "hasBody(" << var << ", " << body << ").\n";
+      }
 
       
       RangeKindToGUIDMap varNames;
@@ -698,7 +941,7 @@ namespace
       DeclForTypeVisitor dftv;
       Decl* D = dftv.Visit(qt.getTypePtr());
       
-      return declToSymbolMap[D];
+      return lookupDeclSymbol(os, *SM, D);
     }
     
     void printDeclKindAndName(NamedDecl *D, const char* kindName="")
@@ -711,12 +954,6 @@ namespace
          << " " << D->getQualifiedNameAsString() << "\n";
     }
     
-    bool isInMainFile(SourceRange sr)
-    {
-      FullSourceLoc sl(sr.getBegin(), *SM);
-      return !sl.isInSystemHeader(); //SM->isFromMainFile(sr.getBegin());
-    }
-    
   private:
     RawOS & os;
     ASTContext * astContext;
@@ -738,18 +975,41 @@ namespace
   protected:
     ASTConsumer* CreateASTConsumer(CompilerInstance &CI, llvm::StringRef sref)
     {
+      if (rangeJobs > 1)
+      {
+        deferredRanges = new DeferredRanges(*os);
+        return new ConstraintGenerator(deferredRanges->output());
+      }
       return new ConstraintGenerator(*os);
     }
     
     bool ParseArgs(const CompilerInstance& CI,
                    const std::vector<String> & args)
     {
+      const String editablePrefix("editable=");
+      const String jobsPrefix("jobs=");
+      
       for(size_t i = 0; i < args.size(); ++i)
       {
         std::cout << "Arg " << i << " = " << args[i] << std::endl;
+        
+        if(args[i] == "main-only")
+        {
+          restrictToEditableFiles = true;
+        }
+        else if(args[i].compare(0, editablePrefix.size(), editablePrefix) == 0)
+        {
+          restrictToEditableFiles = true;
+          editableFiles.insert(args[i].substr(editablePrefix.size()));
+        }
+        else if(args[i].compare(0, jobsPrefix.size(), jobsPrefix) == 0)
+        {
+          int jobs = atoi(args[i].substr(jobsPrefix.size()).c_str());
+          rangeJobs = (jobs > 1) ? jobs : 1;
+        }
       }
       
-      os = new RawOS("out.txt", streamErrors);
+      os = new llvm::raw_fd_ostream("out.txt", streamErrors);
       
       if(args.size() > 0 && args[0] == "help")
       {
@@ -761,7 +1021,11 @@ namespace
     
     void PrintHelp(llvm::raw_ostream& os)
     {
-      os << "GenerateConstraints help\n";
+      os << "GenerateConstraints help\n"
+         << "  main-only        only generate constraints for the main file\n"
+         << "  editable=FILE    also generate constraints for FILE "
+         << "(implies main-only)\n"
+         << "  jobs=N           scan statement source ranges with N threads\n";
     }
     
   private:
@@ -864,6 +1128,52 @@ namespace
     }
   }
   
+  bool isEditable(SourceManager & SM, SourceLocation loc)
+  {
+    FullSourceLoc sl(loc, SM);
+    
+    if (!restrictToEditableFiles)
+    {
+      return !sl.isInSystemHeader();
+    }
+    
+    if (loc.isInvalid())
+    {
+      return false;
+    }
+    
+    return SM.isFromMainFile(loc) ||
+      (editableFiles.find(SM.getBufferName(loc)) != editableFiles.end());
+  }
+  
+  // Declarations outside the editable files never get a source range of their
+  // own, but references to them still need a symbol for the dependency edges
+  // to be right. Those get an isExternal anchor the first time they are used.
+  String lookupDeclSymbol(RawOS &os, SourceManager & SM, Decl * D)
+  {
+    if (!restrictToEditableFiles || D == NULL ||
+        declToSymbolMap.find(D) != declToSymbolMap.end() ||
+        isEditable(SM, D->getLocation()))
+    {
+      return declToSymbolMap[D];
+    }
+    
+    String symbol = getNewGUID();
+    
+    declToSymbolMap[D] = symbol;
+    symbolToDeclMap[symbol] = D;
+    
+    os << "%% external " << D->getDeclKindName();
+    if (NamedDecl::classof(D))
+    {
+      os << " " << static_cast<NamedDecl *>(D)->getQualifiedNameAsString();
+    }
+    os << "\nisExternal(" << symbol << ").\n";
+    os.flush();
+    
+    return symbol;
+  }
+  
   void VisitInceptionPoint(RawOS &os, ASTContext &Context, Decl * D)
   {
     ConstraintGenerator g(os, Context);
@@ -0,0 +1,226 @@
+#include <stdint.h>
+#include <vector>
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendPluginRegistry.h>
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace clang;
+
+namespace
+{
+  typedef llvm::raw_fd_ostream RawOS;
+
+  typedef std::string String;
+
+  // A stretch of the main file that pulls in another file: an #include line,
+  // or in preprocessed input everything from the line marker entering a
+  // header up to and including the one returning to the main file.
+  struct IncludeRegion
+  {
+    unsigned int begin;
+    unsigned int end;
+  };
+
+  typedef std::vector<IncludeRegion> IncludeRegions;
+
+  // Tracks how deep the preprocessor is in included files and records a
+  // region every time it leaves the main file and comes back. Nested
+  // includes are part of the region of the top level one.
+  class IncludeRegionTracker : public PPCallbacks
+  {
+  public:
+    IncludeRegionTracker(SourceManager & mgr, RawOS & stream)
+      :SM(mgr),
+       os(stream),
+       regionBegin(0)
+    {
+    }
+
+    virtual void FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                             SrcMgr::CharacteristicKind FileType)
+    {
+      if (Reason == EnterFile)
+      {
+        enterFile(Loc);
+      }
+      else if (Reason == ExitFile)
+      {
+        exitFile(Loc);
+      }
+    }
+
+    virtual void EndOfMainFile()
+    {
+      for (size_t i = 0; i < regions.size(); ++i)
+      {
+        os << "includeRegion(" << i << "," << regions[i].begin << ","
+           << regions[i].end << ").\n";
+      }
+      os.flush();
+    }
+
+  private:
+    void enterFile(SourceLocation Loc)
+    {
+      FileID mainFile = SM.getMainFileID();
+
+      // a line marker moves the main file into a header without a new
+      // FileID; Loc is at the start of the line after the marker
+      if (SM.getFileID(Loc) == mainFile)
+      {
+        unsigned int offset = SM.getFileOffset(Loc);
+        if (depth() == 0)
+        {
+          regionBegin = lineBegin(offset > 0 ? offset - 1 : 0);
+        }
+        fromLineMarker.push_back(true);
+        return;
+      }
+
+      // a real #include: the include location is the file name token in
+      // the including file
+      SourceLocation includeLoc = SM.getIncludeLoc(SM.getFileID(Loc));
+      bool nested = depth() > 0;
+      bool fromMainFile = includeLoc.isValid() &&
+        SM.getFileID(includeLoc) == mainFile;
+
+      if (!nested && !fromMainFile)
+      {
+        // the predefines buffer and the like
+        ignored.push_back(fromLineMarker.size());
+        return;
+      }
+      if (!nested)
+      {
+        unsigned int offset = SM.getFileOffset(includeLoc);
+        IncludeRegion region;
+        region.begin = lineBegin(offset);
+        region.end = lineEnd(offset);
+        regions.push_back(region);
+      }
+      fromLineMarker.push_back(false);
+    }
+
+    void exitFile(SourceLocation Loc)
+    {
+      if (!ignored.empty() && ignored.back() == fromLineMarker.size())
+      {
+        ignored.pop_back();
+        return;
+      }
+      if (fromLineMarker.empty())
+      {
+        return;
+      }
+
+      bool wasLineMarker = fromLineMarker.back();
+      fromLineMarker.pop_back();
+
+      // the region ends with the marker that returns to the main file
+      if (depth() == 0 && wasLineMarker &&
+          SM.getFileID(Loc) == SM.getMainFileID())
+      {
+        IncludeRegion region;
+        region.begin = regionBegin;
+        region.end = SM.getFileOffset(Loc);
+        regions.push_back(region);
+      }
+    }
+
+    size_t depth()
+    {
+      return fromLineMarker.size();
+    }
+
+    const llvm::MemoryBuffer * mainBuffer()
+    {
+      return SM.getBuffer(SM.getMainFileID());
+    }
+
+    unsigned int lineBegin(unsigned int offset)
+    {
+      const char * start = mainBuffer()->getBufferStart();
+      while (offset > 0 && start[offset - 1] != '\n')
+      {
+        --offset;
+      }
+      return offset;
+    }
+
+    // one past the newline ending the line OFFSET is in
+    unsigned int lineEnd(unsigned int offset)
+    {
+      const char * start = mainBuffer()->getBufferStart();
+      unsigned int size = mainBuffer()->getBufferSize();
+      while (offset < size && start[offset] != '\n')
+      {
+        ++offset;
+      }
+      return offset < size ? offset + 1 : size;
+    }
+
+    SourceManager & SM;
+    RawOS & os;
+
+    IncludeRegions regions;
+    unsigned int regionBegin;
+    // one entry per file entered from the main file or below it
+    std::vector<bool> fromLineMarker;
+    // depths at which files we don't track were entered
+    std::vector<size_t> ignored;
+  };
+
+  class IncludeRegionsAction : public PluginASTAction
+  {
+  public:
+    IncludeRegionsAction()
+      :os(NULL)
+    {
+    }
+
+    virtual ~IncludeRegionsAction()
+    {
+    }
+
+  protected:
+    ASTConsumer* CreateASTConsumer(CompilerInstance &CI, llvm::StringRef sref)
+    {
+      CI.getPreprocessor().addPPCallbacks(
+        new IncludeRegionTracker(CI.getSourceManager(), *os));
+      return new ASTConsumer();
+    }
+
+    bool ParseArgs(const CompilerInstance& CI,
+                   const std::vector<String> & args)
+    {
+      os = new RawOS("regions.txt", streamErrors);
+
+      if(args.size() > 0 && args[0] == "help")
+      {
+        PrintHelp(llvm::errs());
+      }
+
+      return true;
+    }
+
+    void PrintHelp(llvm::raw_ostream& os)
+    {
+      os << "IncludeRegions help\n"
+         << "  writes includeRegion(N, Begin, End) for every #include line\n"
+         << "  and line marker region of the main file to regions.txt\n";
+    }
+
+  private:
+    RawOS * os;
+    String streamErrors;
+  };
+}
+
+static FrontendPluginRegistry::Add<IncludeRegionsAction>
+X("gen-include-regions", "Find the include regions of the main file");
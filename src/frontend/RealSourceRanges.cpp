@@ -19,10 +19,112 @@
 
 using namespace clang;
 
+ResolvedLocation resolveLocation(const SourceManager & SM, SourceLocation loc)
+{
+  ResolvedLocation resolved;
+  resolved.invalid = loc.isInvalid();
+  resolved.bufferStart = NULL;
+  resolved.bufferEnd = NULL;
+  resolved.characterData = NULL;
+  resolved.bufferName = NULL;
+  if (resolved.invalid)
+  {
+    return resolved;
+  }
+  
+  FullSourceLoc location(loc, SM);
+  const llvm::MemoryBuffer *memBuffer = location.getBuffer();
+  resolved.bufferStart = memBuffer->getBufferStart();
+  resolved.bufferEnd = memBuffer->getBufferEnd();
+  resolved.characterData = location.getCharacterData();
+  resolved.bufferName = memBuffer->getBufferIdentifier();
+  return resolved;
+}
+
+void ResolvedLocations::add(const SourceManager & SM, Stmt * S)
+{
+  add(SM, S->getLocStart());
+  add(SM, S->getLocEnd());
+  for (Stmt::child_iterator child = S->child_begin();
+       child != S->child_end();
+       ++child)
+  {
+    if (*child != NULL)
+    {
+      add(SM, (*child)->getLocStart());
+      add(SM, (*child)->getLocEnd());
+    }
+  }
+}
+
+void ResolvedLocations::add(const SourceManager & SM, SourceLocation loc)
+{
+  unsigned key = loc.getRawEncoding();
+  if (locations.find(key) == locations.end())
+  {
+    locations[key] = resolveLocation(SM, loc);
+  }
+}
+
+ResolvedLocation ResolvedLocations::resolve(SourceLocation loc) const
+{
+  std::map<unsigned, ResolvedLocation>::const_iterator it =
+    locations.find(loc.getRawEncoding());
+  // add() covers every location the statement scan asks for
+  assert(it != locations.end());
+  return it->second;
+}
+
 namespace
 {
-  DeclToSymMap declToSymbolMap;
-  StmtToSymMap stmtToSymbolMap;
+  // Answers from the symbol maps the caller keeps, without copying them.
+  class MapSymbolLookup : public SymbolLookup
+  {
+  public:
+    MapSymbolLookup(const DeclToSymMap * decls, const StmtToSymMap * stmts)
+      :declToSymbolMap(decls),
+       stmtToSymbolMap(stmts)
+    {
+    }
+    
+    std::string symbolFor(Decl * D) const
+    {
+      if (declToSymbolMap == NULL)
+        return "";
+      DeclToSymMap::const_iterator it = declToSymbolMap->find(D);
+      return (it == declToSymbolMap->end()) ? "" : it->second;
+    }
+    
+    std::string symbolFor(Stmt * S) const
+    {
+      if (stmtToSymbolMap == NULL)
+        return "";
+      StmtToSymMap::const_iterator it = stmtToSymbolMap->find(S);
+      return (it == stmtToSymbolMap->end()) ? "" : it->second;
+    }
+    
+  private:
+    const DeclToSymMap * declToSymbolMap;
+    const StmtToSymMap * stmtToSymbolMap;
+  };
+  
+  // Looks locations up as they are asked for.
+  class SourceManagerResolver : public LocationResolver
+  {
+  public:
+    SourceManagerResolver(const SourceManager & mgr)
+      :SM(mgr)
+    {
+    }
+    
+    ResolvedLocation resolve(SourceLocation loc) const
+    {
+      return resolveLocation(SM, loc);
+    }
+    
+  private:
+    const SourceManager & SM;
+  };
   
   enum ScanDirection
   {
@@ -75,26 +177,25 @@ namespace
   
   size_t scan(ScanDirection direction,
               const std::string &keyword,
-              FullSourceLoc location,
+              const ResolvedLocation & location,
               bool isInclusive = true,
               bool orParen = false,
               bool orBrace = false)
   {
     // clang may give us invalid source locations for things it dreams up. we
     // need to check for that. eg decare an anonymous struct within main()
-    if (location.isInvalid())
+    if (location.invalid)
       {
 	return 0;
       }
     
-    const llvm::MemoryBuffer *memBuffer = location.getBuffer();
-    const char * buffer = memBuffer->getBufferStart();
-    const char * token  = location.getCharacterData();
+    const char * buffer = location.bufferStart;
+    const char * token  = location.characterData;
     
     size_t current = token - buffer;
     
-    const char * beginning = memBuffer->getBufferStart();
-    const char * end = memBuffer->getBufferEnd();
+    const char * beginning = location.bufferStart;
+    const char * end = location.bufferEnd;
     
     do {
       if (orParen) {
@@ -137,6 +238,18 @@ namespace
     throw TokenScanException(keyword, token - buffer, direction);
   }
   
+  size_t scan(ScanDirection direction,
+              const std::string &keyword,
+              FullSourceLoc location,
+              bool isInclusive = true,
+              bool orParen = false,
+              bool orBrace = false)
+  {
+    return scan(direction, keyword,
+                resolveLocation(location.getManager(), location),
+                isInclusive, orParen, orBrace);
+  }
+  
   /*
   size_t scanBackTo(const std::string & keyword,
                     FullSourceLoc sl,
@@ -258,8 +371,9 @@ namespace
   class DeclSourceRangeVisitor : public DeclVisitor<DeclSourceRangeVisitor, OffsetRanges>
   {
   public:
-    DeclSourceRangeVisitor(SourceManager & SMan)
-      :SM(SMan)
+    DeclSourceRangeVisitor(SourceManager & SMan, const SymbolLookup & lookup)
+      :SM(SMan),
+       symbols(lookup)
     {
     }
     
@@ -272,13 +386,13 @@ namespace
       size_t typedefEnd = scan(SCAN_FORWARD, ";", definedTypeBegin);
       
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(declToSymbolMap[D],
+                     OffsetRange(symbols.symbolFor(D),
                                  typedefBegin,
                                  typedefEnd,
                                  definedTypeBegin.getBuffer()->getBufferIdentifier(),
                                  DECL));
       _debug("TypedefDecl::DECL          - ");
-      _debug(declToSymbolMap[D]);
+      _debug(symbols.symbolFor(D));
       _debug("\n");
       
       return oRanges;
@@ -292,13 +406,13 @@ namespace
       size_t typedefBegin = scan(SCAN_BACKWARD, getDeclStartToken(D), definedTypeBegin);
       size_t typedefEnd = scan(SCAN_FORWARD, ";", definedTypeBegin);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(declToSymbolMap[D],
+                     OffsetRange(symbols.symbolFor(D),
                                  typedefBegin,
                                  typedefEnd,
                                  definedTypeBegin.getBuffer()->getBufferIdentifier(),
                                  DECL));
       _debug("EnumDecl::DECL             - ");
-      _debug(declToSymbolMap[D]);
+      _debug(symbols.symbolFor(D));
       _debug("\n");
       
       return oRanges;
@@ -320,13 +434,13 @@ namespace
       size_t typedefBegin = scan(SCAN_BACKWARD, getDeclStartToken(D), definedTypeBegin);
       size_t typedefEnd = scan(SCAN_FORWARD, ";", definedTypeEnd);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(declToSymbolMap[D],
+                     OffsetRange(symbols.symbolFor(D),
                                  typedefBegin,
                                  typedefEnd,
                                  definedTypeBegin.getBuffer()->getBufferIdentifier(),
                                  DECL));
       _debug("RecordDecl::DECL           - ");
-      _debug(declToSymbolMap[D]);
+      _debug(symbols.symbolFor(D));
       _debug("\n");
       
       return oRanges;
@@ -345,13 +459,13 @@ namespace
       
       SourceLocation qBegin = SM.getSpellingLoc(D->getTypeSpecStartLoc());//qr.getBegin());
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(declToSymbolMap[D],
+                     OffsetRange(symbols.symbolFor(D),
                                  beginLoc,
                                  SM.getFileOffset(sEnd) + 1, // TODO: check (SSS)
                                  SM.getBufferName(sBegin),
                                  DECL));
       _debug("VarDecl::DECL              - ");
-      _debug(declToSymbolMap[D]);
+      _debug(symbols.symbolFor(D));
       _debug("\n");
       
       return oRanges;
@@ -369,13 +483,13 @@ namespace
     //   size_t beginLoc = scan(SCAN_BACKWARD, ",", parmB, false, true);
     //   size_t endLoc = scan(SCAN_FORWARD, ",", parmE, false, true);
     //   oRanges.insert(oRanges.begin(),
-    //                  OffsetRange(declToSymbolMap[D],
+    //                  OffsetRange(symbols.symbolFor(D),
     //                              beginLoc,
     //                              endLoc, // TODO: check (SSS)
     //                              parmB.getBuffer()->getBufferIdentifier(),
     //                              DECL));
     //   _debug("ParmVarDecl::DECL          - ");
-    //   _debug(declToSymbolMap[D]);
+    //   _debug(symbols.symbolFor(D));
     //   _debug("\n");
       
     //   return oRanges;
@@ -396,13 +510,13 @@ namespace
       size_t beginLoc = scan(SCAN_BACKWARD, ";", fieldB, false, false, true);
       size_t endLoc = scan(SCAN_FORWARD, ";", fieldE, true, false, true);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(declToSymbolMap[D],
+                     OffsetRange(symbols.symbolFor(D),
                                  beginLoc,
                                  endLoc,
                                  fieldB.getBuffer()->getBufferIdentifier(),
                                  DECL));
       _debug("FieldDecl::DECL            - ");
-      _debug(declToSymbolMap[D]);
+      _debug(symbols.symbolFor(D));
       _debug("\n");
       
       return oRanges;
@@ -447,13 +561,13 @@ namespace
 	  endLoc = scan(SCAN_FORWARD, ";", funE, true);
 	}
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(declToSymbolMap[D],
+                     OffsetRange(symbols.symbolFor(D),
                                  beginLoc,
                                  endLoc,
                                  funB.getBuffer()->getBufferIdentifier(),
                                  DECL));
       _debug("FunctionDecl::DECL         - ");
-      _debug(declToSymbolMap[D]);
+      _debug(symbols.symbolFor(D));
       _debug("\n");
       
       return oRanges;
@@ -467,17 +581,18 @@ namespace
       throw DeclRangeCalculatorNotImplementedException(D);
     }
     
-    DeclToSymMap declToSymbolMap;
-    
   private:
     SourceManager & SM;
+    const SymbolLookup & symbols;
   };
   
   class StmtSourceRangeVisitor : public StmtVisitor<StmtSourceRangeVisitor, OffsetRanges>
   {
   public:
-    StmtSourceRangeVisitor(SourceManager & SMan)
-      :SM(SMan)
+    StmtSourceRangeVisitor(const LocationResolver & resolver,
+                           const SymbolLookup & lookup)
+      :locations(resolver),
+       symbols(lookup)
     {
     }
     
@@ -486,32 +601,32 @@ namespace
       OffsetRanges oRanges;
       
       Expr* C = S->getCond();
-      FullSourceLoc condB(C->getLocStart(), SM);
-      FullSourceLoc condE(C->getLocEnd(), SM);
+      ResolvedLocation condB = locations.resolve(C->getLocStart());
+      ResolvedLocation condE = locations.resolve(C->getLocEnd());
       size_t posCondB = scan(SCAN_BACKWARD, "(", condB, false);
       size_t posCondE = scan(SCAN_FORWARD, ")", condE, false);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[C],
+                     OffsetRange(symbols.symbolFor(C),
                                  posCondB,
                                  posCondE,
-                                 condB.getBuffer()->getBufferIdentifier(),
+                                 condB.bufferName,
                                  IFCONDITION));
       _debug("DoStmt::IFCONDITION        - ");
-      _debug(stmtToSymbolMap[C]);
+      _debug(symbols.symbolFor(C));
       _debug("\n");
       
       Stmt* B = S->getBody();
-      FullSourceLoc bodyB(B->getLocStart(), SM);
+      ResolvedLocation bodyB = locations.resolve(B->getLocStart());
       size_t posBodyB = scan(SCAN_BACKWARD, "do", bodyB, true);
       size_t posBodyE = scan(SCAN_FORWARD, ";", condE, true);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[S],
+                     OffsetRange(symbols.symbolFor(S),
                                  posBodyB,
                                  posBodyE,
-                                 bodyB.getBuffer()->getBufferIdentifier(),
+                                 bodyB.bufferName,
                                  STMT));
       _debug("DoStmt::STMT               - ");
-      _debug(stmtToSymbolMap[S]);
+      _debug(symbols.symbolFor(S));
       _debug("\n");
       
       return oRanges;
@@ -522,23 +637,23 @@ namespace
       OffsetRanges oRanges;
       
       Expr* C = S->getCond();
-      FullSourceLoc condB(C->getLocStart(), SM);
-      FullSourceLoc condE(C->getLocEnd(), SM);
+      ResolvedLocation condB = locations.resolve(C->getLocStart());
+      ResolvedLocation condE = locations.resolve(C->getLocEnd());
       size_t posCondB = scan(SCAN_BACKWARD, "(", condB, false);
       size_t posCondE = scan(SCAN_FORWARD, ")", condE, false);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[C],
+                     OffsetRange(symbols.symbolFor(C),
                                  posCondB,
                                  posCondE,
-                                 condB.getBuffer()->getBufferIdentifier(),
+                                 condB.bufferName,
                                  IFCONDITION));
       _debug("WhileStmt::IFCONDITION     - ");
-      _debug(stmtToSymbolMap[C]);
+      _debug(symbols.symbolFor(C));
       _debug("\n");
       
       Stmt* B = S->getBody();
-      FullSourceLoc bodyB(B->getLocStart(), SM);
-      FullSourceLoc bodyE(B->getLocEnd(), SM);
+      ResolvedLocation bodyB = locations.resolve(B->getLocStart());
+      ResolvedLocation bodyE = locations.resolve(B->getLocEnd());
       size_t posBodyB = scan(SCAN_BACKWARD, "while", bodyB, true);
       size_t posBodyE;
       if (CompoundStmt::classof(B))
@@ -550,13 +665,13 @@ namespace
 	  posBodyE = scan(SCAN_FORWARD, ";", bodyE, true);
 	}
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[S],
+                     OffsetRange(symbols.symbolFor(S),
                                  posBodyB,
                                  posBodyE,
-                                 bodyB.getBuffer()->getBufferIdentifier(),
+                                 bodyB.bufferName,
                                  STMT));
       _debug("WhileStmt::STMT            - ");
-      _debug(stmtToSymbolMap[S]);
+      _debug(symbols.symbolFor(S));
       _debug("\n");
       
       return oRanges;
@@ -567,8 +682,8 @@ namespace
       OffsetRanges oRanges;
 
       Stmt* B = S->getBody();
-      FullSourceLoc bodyB(B->getLocStart(), SM);
-      FullSourceLoc bodyE(B->getLocEnd(), SM);
+      ResolvedLocation bodyB = locations.resolve(B->getLocStart());
+      ResolvedLocation bodyE = locations.resolve(B->getLocEnd());
       size_t posBodyB = scan(SCAN_BACKWARD, "for", bodyB, true);
       size_t posBodyE;
       if (CompoundStmt::classof(B))
@@ -579,15 +694,15 @@ namespace
 	{
 	  posBodyE = scan(SCAN_FORWARD, ";", bodyE, true);
 	}
-      const char* fileName = bodyB.getBuffer()->getBufferIdentifier();
+      const char* fileName = bodyB.bufferName;
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[S],
+                     OffsetRange(symbols.symbolFor(S),
                                  posBodyB,
                                  posBodyE,
                                  fileName,
                                  STMT));
       _debug("ForStmt::STMT              - ");
-      _debug(stmtToSymbolMap[S]);
+      _debug(symbols.symbolFor(S));
       _debug("\n");      
 
       Stmt* init = S->getInit();
@@ -595,8 +710,8 @@ namespace
       size_t posInitE;
       if (init)
 	{
-	  FullSourceLoc initB(init->getLocStart(), SM);
-	  FullSourceLoc initE(init->getLocEnd(), SM);
+	  ResolvedLocation initB = locations.resolve(init->getLocStart());
+	  ResolvedLocation initE = locations.resolve(init->getLocEnd());
 	  posInitB = scan(SCAN_BACKWARD, "(", initB, false);
 	  posInitE = scan(SCAN_FORWARD, ";", initE, false);
 	}
@@ -607,13 +722,13 @@ namespace
 	}
       
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[init],
+                     OffsetRange(symbols.symbolFor(init),
                                  posInitB,
                                  posInitE,
                                  fileName,
                                  INITIALIZER));
       _debug("ForStmt::INITIALIZER       - ");
-      _debug(stmtToSymbolMap[init]);
+      _debug(symbols.symbolFor(init));
       _debug("\n");
       
       Expr* C = S->getCond();
@@ -621,8 +736,8 @@ namespace
       size_t conditionEnd;
       if (C)
 	{
-	  FullSourceLoc ifConditionB(C->getLocStart(), SM);
-	  FullSourceLoc ifConditionE(C->getLocEnd(), SM);
+	  ResolvedLocation ifConditionB = locations.resolve(C->getLocStart());
+	  ResolvedLocation ifConditionE = locations.resolve(C->getLocEnd());
 	  conditionBegin = scan(SCAN_BACKWARD, ";", ifConditionB, false);
 	  conditionEnd = scan(SCAN_FORWARD, ";", ifConditionE, false);
 	}
@@ -632,13 +747,13 @@ namespace
 	  conditionEnd = 0;
 	}
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[C],
+                     OffsetRange(symbols.symbolFor(C),
                                  conditionBegin,
                                  conditionEnd,
                                  fileName,
                                  IFCONDITION));
       _debug("ForStmt::IFCONDITION       - ");
-      _debug(stmtToSymbolMap[C]);
+      _debug(symbols.symbolFor(C));
       _debug("\n");
       
       Expr* inc = S->getInc();
@@ -646,8 +761,8 @@ namespace
       size_t posIncE;
       if (inc)
 	{
-	  FullSourceLoc incB(inc->getLocStart(), SM);
-	  FullSourceLoc incE(inc->getLocEnd(), SM);
+	  ResolvedLocation incB = locations.resolve(inc->getLocStart());
+	  ResolvedLocation incE = locations.resolve(inc->getLocEnd());
 	  posIncB = scan(SCAN_BACKWARD, ";", incB, false);
 	  posIncE = scan(SCAN_FORWARD, ")", incE, false);
 	}
@@ -658,13 +773,13 @@ namespace
 	}
       
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[inc],
+                     OffsetRange(symbols.symbolFor(inc),
                                  posIncB,
                                  posIncE,
                                  fileName,
                                  EXPR));
       _debug("ForStmt::EXPR              - ");
-      _debug(stmtToSymbolMap[inc]);
+      _debug(symbols.symbolFor(inc));
       _debug("\n");
       
       return oRanges;
@@ -675,24 +790,24 @@ namespace
       OffsetRanges oRanges;
       
       Expr* C = S->getCond();
-      FullSourceLoc ifConditionB(C->getLocStart(), SM);
-      FullSourceLoc ifConditionE(C->getLocEnd(), SM);
+      ResolvedLocation ifConditionB = locations.resolve(C->getLocStart());
+      ResolvedLocation ifConditionE = locations.resolve(C->getLocEnd());
       size_t conditionBegin = scan(SCAN_BACKWARD, "(", ifConditionB, false);
       size_t conditionEnd = scan(SCAN_FORWARD, ")", ifConditionE, false);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[C],
+                     OffsetRange(symbols.symbolFor(C),
                                  conditionBegin,
                                  conditionEnd,
-                                 ifConditionB.getBuffer()->getBufferIdentifier(),
+                                 ifConditionB.bufferName,
                                  IFCONDITION));
       _debug("IfStmt::IFCONDITION        - ");
-      _debug(stmtToSymbolMap[C]);
+      _debug(symbols.symbolFor(C));
       _debug("\n");
       
       Stmt* T = S->getThen();
       Stmt* E = (S->getElse() != NULL) ? S->getElse() : S->getThen();      
-      FullSourceLoc ifBlockB(T->getLocStart(), SM);
-      FullSourceLoc ifBlockE(E->getLocEnd(), SM);
+      ResolvedLocation ifBlockB = locations.resolve(T->getLocStart());
+      ResolvedLocation ifBlockE = locations.resolve(E->getLocEnd());
       size_t ifBegin = scan(SCAN_BACKWARD, "if", ifBlockB, true);
       size_t ifEnd;
       if (CompoundStmt::classof(E))
@@ -704,13 +819,13 @@ namespace
 	  ifEnd = scan(SCAN_FORWARD, ";", ifBlockE, true);
 	}
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[S],
+                     OffsetRange(symbols.symbolFor(S),
                                  ifBegin,
                                  ifEnd,
-                                 ifBlockB.getBuffer()->getBufferIdentifier(),
+                                 ifBlockB.bufferName,
                                  STMT));
       _debug("IfStmt::STMT               - ");
-      _debug(stmtToSymbolMap[S]);
+      _debug(symbols.symbolFor(S));
       _debug("\n");
       
       return oRanges;
@@ -720,18 +835,18 @@ namespace
     {
       OffsetRanges oRanges;
       
-      FullSourceLoc stmtBegin(S->getLocStart(), SM);
-      FullSourceLoc stmtEnd(S->getLocEnd(), SM);
+      ResolvedLocation stmtBegin = locations.resolve(S->getLocStart());
+      ResolvedLocation stmtEnd = locations.resolve(S->getLocEnd());
       size_t posBegin = scan(SCAN_BACKWARD, "{", stmtBegin, true);
       size_t posEnd = scan(SCAN_FORWARD, "}", stmtEnd, true);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[S],
+                     OffsetRange(symbols.symbolFor(S),
                                  posBegin,
                                  posEnd,
-                                 stmtBegin.getBuffer()->getBufferIdentifier(),
+                                 stmtBegin.bufferName,
                                  COMPOUNDSTMT));
       _debug("CompoundStmt::COMPOUNDSTMT - ");
-      _debug(stmtToSymbolMap[S]);
+      _debug(symbols.symbolFor(S));
       _debug("\n");
       
       return oRanges;
@@ -742,20 +857,20 @@ namespace
       OffsetRanges oRanges;
 
       SourceRange sr = E->getSourceRange();
-      FullSourceLoc exprBegin(sr.getBegin(), SM);
-      FullSourceLoc exprEnd(sr.getEnd(), SM);
-      size_t posBegin = exprBegin.getCharacterData()
-                      - exprBegin.getBuffer()->getBufferStart();
-      size_t posEnd = exprEnd.getCharacterData()
-                    - exprEnd.getBuffer()->getBufferStart();
+      ResolvedLocation exprBegin = locations.resolve(sr.getBegin());
+      ResolvedLocation exprEnd = locations.resolve(sr.getEnd());
+      size_t posBegin = exprBegin.characterData
+                      - exprBegin.bufferStart;
+      size_t posEnd = exprEnd.characterData
+                    - exprEnd.bufferStart;
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[E],
+                     OffsetRange(symbols.symbolFor(E),
                                  posBegin,
                                  posEnd + 1, // TODO: check (SSS)
-                                 exprBegin.getBuffer()->getBufferIdentifier(),
+                                 exprBegin.bufferName,
                                  EXPR));
       _debug("Expr::EXPR                 - ");
-      _debug(stmtToSymbolMap[E]);
+      _debug(symbols.symbolFor(E));
       _debug("\n");
       
       return oRanges;
@@ -765,43 +880,55 @@ namespace
     {
       OffsetRanges oRanges;
       
-      FullSourceLoc stmtBegin(S->getLocStart(), SM);
-      FullSourceLoc stmtEnd(S->getLocEnd(), SM);
+      ResolvedLocation stmtBegin = locations.resolve(S->getLocStart());
+      ResolvedLocation stmtEnd = locations.resolve(S->getLocEnd());
       S->dump();
       
-      size_t posBegin = stmtBegin.getCharacterData()
-                      - stmtBegin.getBuffer()->getBufferStart();
+      size_t posBegin = stmtBegin.characterData
+                      - stmtBegin.bufferStart;
       size_t posEnd = scan(SCAN_FORWARD, ";", stmtEnd, true);
       oRanges.insert(oRanges.begin(),
-                     OffsetRange(stmtToSymbolMap[S],
+                     OffsetRange(symbols.symbolFor(S),
                                  posBegin,
                                  posEnd,
-                                 stmtBegin.getBuffer()->getBufferIdentifier(),
+                                 stmtBegin.bufferName,
                                  STMT));
       _debug("Stmt::STMT                 - ");
-      _debug(stmtToSymbolMap[S]);
+      _debug(symbols.symbolFor(S));
       _debug("\n");
       
       return oRanges;
     }
     
-    StmtToSymMap stmtToSymbolMap;
-    
   private:
-    SourceManager & SM;
+    const LocationResolver & locations;
+    const SymbolLookup & symbols;
   };
 }
 
-OffsetRanges getRealSourceRange(SourceManager & SM, Decl *D, DeclToSymMap map)
+OffsetRanges getRealSourceRange(SourceManager & SM, Decl *D, const DeclToSymMap & map)
+{
+  return getRealSourceRange(SM, D, MapSymbolLookup(&map, NULL));
+}
+
+OffsetRanges getRealSourceRange(SourceManager & SM, Stmt *S, const StmtToSymMap & map)
+{
+  return getRealSourceRange(SM, S, MapSymbolLookup(NULL, &map));
+}
+
+OffsetRanges getRealSourceRange(SourceManager & SM, Decl *D, const SymbolLookup & symbols)
 {
-  DeclSourceRangeVisitor dsrv(SM);
-  dsrv.declToSymbolMap = map;
+  DeclSourceRangeVisitor dsrv(SM, symbols);
   return dsrv.Visit(D);
 }
 
-OffsetRanges getRealSourceRange(SourceManager & SM, Stmt *S, StmtToSymMap map)
+OffsetRanges getRealSourceRange(SourceManager & SM, Stmt *S, const SymbolLookup & symbols)
+{
+  return getRealSourceRange(S, SourceManagerResolver(SM), symbols);
+}
+
+OffsetRanges getRealSourceRange(Stmt *S, const LocationResolver & locations, const SymbolLookup & symbols)
 {
-  StmtSourceRangeVisitor ssrv(SM);
-  ssrv.stmtToSymbolMap = map;
+  StmtSourceRangeVisitor ssrv(locations, symbols);
   return ssrv.Visit(S);
 }
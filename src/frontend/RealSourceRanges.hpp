@@ -4,10 +4,13 @@
 #include <utility>
 #include <map>
 
+#include <clang/Basic/SourceLocation.h>
+
 namespace clang
 {
   class SourceManager;
   class Decl;
+  class Stmt;
 }
 
 enum RangeQualifier
@@ -63,7 +66,57 @@ typedef std::map<clang::Stmt *, std::string> StmtToSymMap;
 typedef std::vector<OffsetRange> OffsetRanges;
 typedef std::map<RangeQualifier, std::string> RangeKindToGUIDMap;
 
-OffsetRanges getRealSourceRange(clang::SourceManager & SM, clang::Decl *D, DeclToSymMap map);
-OffsetRanges getRealSourceRange(clang::SourceManager & SM, clang::Stmt *D, StmtToSymMap map);
+// Where the range visitors get the symbols of the nodes they describe from.
+// A node without a symbol gets the empty string.
+class SymbolLookup
+{
+public:
+  virtual ~SymbolLookup() { }
+  virtual std::string symbolFor(clang::Decl * D) const = 0;
+  virtual std::string symbolFor(clang::Stmt * S) const = 0;
+};
+
+// What the range scans need to know about a source location: the buffer it
+// is in and where in it. Looked up through a FullSourceLoc, which goes
+// through the SourceManager.
+struct ResolvedLocation
+{
+  bool invalid;
+  const char * bufferStart;
+  const char * bufferEnd;
+  const char * characterData;
+  const char * bufferName;
+};
+
+ResolvedLocation resolveLocation(const clang::SourceManager & SM, clang::SourceLocation loc);
+
+class LocationResolver
+{
+public:
+  virtual ~LocationResolver() { }
+  virtual ResolvedLocation resolve(clang::SourceLocation loc) const = 0;
+};
+
+// The locations the range scan of a statement asks for, looked up ahead of
+// time: those of the statement and of its children. The SourceManager
+// caches its lookups and is not thread-safe, so add() runs on the thread
+// that owns it and other threads then only read the table.
+class ResolvedLocations : public LocationResolver
+{
+public:
+  void add(const clang::SourceManager & SM, clang::Stmt * S);
+  ResolvedLocation resolve(clang::SourceLocation loc) const;
+  
+private:
+  void add(const clang::SourceManager & SM, clang::SourceLocation loc);
+  
+  std::map<unsigned, ResolvedLocation> locations;
+};
+
+OffsetRanges getRealSourceRange(clang::SourceManager & SM, clang::Decl *D, const DeclToSymMap & map);
+OffsetRanges getRealSourceRange(clang::SourceManager & SM, clang::Stmt *D, const StmtToSymMap & map);
+OffsetRanges getRealSourceRange(clang::SourceManager & SM, clang::Decl *D, const SymbolLookup & symbols);
+OffsetRanges getRealSourceRange(clang::SourceManager & SM, clang::Stmt *S, const SymbolLookup & symbols);
+OffsetRanges getRealSourceRange(clang::Stmt *S, const LocationResolver & locations, const SymbolLookup & symbols);
 
 #endif // __REAL__SOURCE__RANGES__HPP